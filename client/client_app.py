@@ -150,7 +150,7 @@ class NetworkWorker(QObject):
                 if buffer[:4] not in {
                     "MOVD", "ROOM", "LOBY", "TICK", 
                     "FULL", "LEFT", "STRT", "PING", 
-                    "WINS", "DRAW", "WAIT"}:
+                    "WINS", "DRAW", "WAIT", "BORD"}:
                     self.disconnect()
                     return
                 
@@ -560,6 +560,8 @@ class MainWindow(QMainWindow):
         self.network.send("LIST")
 
     def join_room(self, room_id):
+        # rooms with another board size announce it with BORD
+        self.game_state.grid_size = GRID_SIZE
         self.network.send(f"JOIN {room_id}")
 
     def start_game(self):
@@ -671,6 +673,10 @@ class MainWindow(QMainWindow):
             # We left the room
             pass
 
+        elif cmd == "BORD":
+            # BORD <size>
+            self.game_state.grid_size = int(tokens[1])
+
         elif cmd == "TICK":
             self.game_state.last_game_result = ""
             self.game_state.last_move = None
@@ -0,0 +1,199 @@
+#include "game.hpp"
+#include "rng.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Headless benchmark of the game simulation.
+ *
+ * Plays games on a matrix of board sizes, player counts and initial snake
+ * lengths with bots steering towards the apple, and prints one CSV row per
+ * combination: nanoseconds and heap allocations per call of hatch,
+ * slither, random_empty_tile, full_state and delta_state, and the bytes
+ * the encoders produce per tick. The encoders append to a reused buffer
+ * like the server's pooled messages. A game that ends is hatched again until
+ * the requested number of ticks is played.
+ */
+
+#define BENCH_DEFAULT_TICKS 20000
+#define BENCH_TILE_DRAWS 100000
+
+static uint64_t allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return ::operator new(size); }
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t elapsed_ns(Clock::time_point since) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              since)
+      .count();
+}
+
+/**
+ * @brief Cost of one operation, summed over all calls.
+ */
+struct Cost {
+  uint64_t calls = 0;
+  uint64_t ns = 0;
+  uint64_t allocs = 0;
+  uint64_t bytes = 0;
+
+  void add(Clock::time_point started, uint64_t allocs_before) {
+    ns += elapsed_ns(started);
+    allocs += allocations - allocs_before;
+    calls++;
+  }
+  double per_call(uint64_t total) const {
+    return calls ? static_cast<double>(total) / calls : 0;
+  }
+};
+
+/**
+ * @brief Turns the snakes that would crash, preferring the apple.
+ *
+ * Only tiles outside the board and occupied ones count as a crash, heads
+ * meeting on the same tile are left to chance.
+ */
+static void steer(Game &game, Rng &rng) {
+  static const Position steps[DIRECTION_COUNT] = {
+      {0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+  for (Player *player : game.players) {
+    if (!player->alive)
+      continue;
+    Position head = player->body.front();
+    int best = -1;
+    int best_distance = 0;
+    int offset = rng.below(DIRECTION_COUNT);
+    for (int i = 0; i < DIRECTION_COUNT; i++) {
+      Direction dir = static_cast<Direction>((i + offset) % DIRECTION_COUNT);
+      if (dir == opposite(player->dir))
+        continue;
+      Position next = head + steps[dir];
+      if (next.x < 0 || next.y < 0 || next.x >= game.size ||
+          next.y >= game.size || !game.is_empty(next))
+        continue;
+      int distance = std::abs(next.x - game.apple.x) +
+                     std::abs(next.y - game.apple.y);
+      if (best < 0 || distance < best_distance) {
+        best = dir;
+        best_distance = distance;
+      }
+    }
+    if (best >= 0)
+      player->dir = static_cast<Direction>(best);
+  }
+}
+
+static void run(int size, int player_count, int length, uint64_t ticks) {
+  Game game;
+  game.configure(size);
+  game.initial_length = length;
+  std::vector<std::unique_ptr<Player>> players;
+  for (int i = 0; i < player_count; i++) {
+    players.push_back(std::make_unique<Player>("bot" + std::to_string(i)));
+    game.add_player(players.back().get());
+  }
+
+  Rng bots(1);
+  Cost hatch, tick, tile, state, delta;
+  std::string text;
+  uint64_t seed = 0;
+  while (tick.calls < ticks) {
+    auto started = Clock::now();
+    uint64_t before = allocations;
+    game.hatch(seed++);
+    hatch.add(started, before);
+
+    bool game_continues = true;
+    while (game_continues && tick.calls < ticks) {
+      steer(game, bots);
+      started = Clock::now();
+      before = allocations;
+      game_continues = game.slither();
+      tick.add(started, before);
+
+      text.clear();
+      started = Clock::now();
+      before = allocations;
+      game.full_state(text);
+      state.add(started, before);
+      state.bytes += text.size();
+
+      text.clear();
+      started = Clock::now();
+      before = allocations;
+      game.delta_state(text);
+      delta.add(started, before);
+      delta.bytes += text.size();
+    }
+    game.active = false;
+  }
+
+  // draws on the board the last game ended with
+  auto started = Clock::now();
+  uint64_t before = allocations;
+  for (int i = 0; i < BENCH_TILE_DRAWS; i++)
+    game.random_empty_tile();
+  tile.ns = elapsed_ns(started);
+  tile.allocs = allocations - before;
+  tile.calls = BENCH_TILE_DRAWS;
+
+  std::cout << size << ',' << player_count << ',' << length << ','
+            << tick.calls << ',' << hatch.calls << ','
+            << hatch.per_call(hatch.ns) << ',' << hatch.per_call(hatch.allocs)
+            << ',' << tick.per_call(tick.ns) << ','
+            << tick.per_call(tick.allocs) << ',' << tile.per_call(tile.ns)
+            << ',' << tile.per_call(tile.allocs) << ','
+            << state.per_call(state.ns) << ',' << state.per_call(state.allocs)
+            << ',' << state.per_call(state.bytes) << ','
+            << delta.per_call(delta.ns) << ',' << delta.per_call(delta.allocs)
+            << ',' << delta.per_call(delta.bytes) << std::endl;
+}
+
+int main(int argc, char **argv) {
+  uint64_t ticks = BENCH_DEFAULT_TICKS;
+  if (argc > 1) {
+    ticks = std::max(1, std::atoi(argv[1]));
+  }
+
+  const int sizes[] = {10, 32, 64, 100};
+  const int player_counts[] = {2, 8, 32};
+  const int lengths[] = {3, 16, 64};
+
+  std::cout << "size,players,length,ticks,games,hatch_ns,hatch_allocs,"
+               "tick_ns,tick_allocs,tile_ns,tile_allocs,state_ns,"
+               "state_allocs,state_bytes,delta_ns,delta_allocs,delta_bytes"
+            << std::endl;
+  for (int size : sizes) {
+    for (int player_count : player_counts) {
+      // every snake needs a tile to hatch on, with some room to move
+      if (player_count * 4 > size * size)
+        continue;
+      for (int length : lengths) {
+        run(size, player_count, length, ticks);
+      }
+    }
+  }
+  return 0;
+}
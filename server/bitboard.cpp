@@ -0,0 +1,64 @@
+#include "bitboard.hpp"
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+Bitboard::Bitboard(size_t cells) : words((cells + 63) / 64, 0) {}
+
+void Bitboard::clear() { std::fill(words.begin(), words.end(), 0); }
+
+void Bitboard::resize(size_t cells) {
+  words.assign((cells + 63) / 64, 0);
+  // a pooled room should not keep the memory of a large board
+  words.shrink_to_fit();
+}
+
+static void test_many_scalar(const uint64_t *words, const uint32_t *cells,
+                             size_t count, uint8_t *hits) {
+  for (size_t i = 0; i < count; i++) {
+    hits[i] = (words[cells[i] >> 6] >> (cells[i] & 63)) & 1;
+  }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) static void
+test_many_avx2(const uint64_t *words, const uint32_t *cells, size_t count,
+               uint8_t *hits) {
+  const __m128i low_bits = _mm_set1_epi32(63);
+  const __m256i one = _mm256_set1_epi64x(1);
+  size_t i = 0;
+  // four tiles per round, the words are gathered and shifted in parallel
+  for (; i + 4 <= count; i += 4) {
+    __m128i cell = _mm_loadu_si128(reinterpret_cast<const __m128i *>(cells + i));
+    __m256i word = _mm256_i32gather_epi64(
+        reinterpret_cast<const long long *>(words), _mm_srli_epi32(cell, 6), 8);
+    __m256i shift = _mm256_cvtepu32_epi64(_mm_and_si128(cell, low_bits));
+    __m256i bit = _mm256_and_si256(_mm256_srlv_epi64(word, shift), one);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(bit, one)));
+    hits[i] = mask & 1;
+    hits[i + 1] = (mask >> 1) & 1;
+    hits[i + 2] = (mask >> 2) & 1;
+    hits[i + 3] = (mask >> 3) & 1;
+  }
+  test_many_scalar(words, cells + i, count - i, hits + i);
+}
+#endif
+
+using test_many_fn = void (*)(const uint64_t *, const uint32_t *, size_t,
+                              uint8_t *);
+
+static test_many_fn pick_test_many() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2"))
+    return test_many_avx2;
+#endif
+  return test_many_scalar;
+}
+
+void Bitboard::test_many(const uint32_t *cells, size_t count,
+                         uint8_t *hits) const {
+  static const test_many_fn impl = pick_test_many();
+  impl(words.data(), cells, count, hits);
+}
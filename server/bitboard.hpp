@@ -0,0 +1,58 @@
+#ifndef BITBOARD_HPP
+#define BITBOARD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Set of grid tiles packed one bit per tile into 64-bit words.
+ *
+ * Tiles are addressed by their index y * width + x.
+ */
+class Bitboard {
+public:
+  /**
+   * @brief Construct an empty Bitboard object.
+   *
+   * @param cells Number of tiles.
+   */
+  explicit Bitboard(size_t cells = 0);
+
+  bool test(uint32_t cell) const {
+    return (words[cell >> 6] >> (cell & 63)) & 1;
+  }
+  void set(uint32_t cell) { words[cell >> 6] |= uint64_t(1) << (cell & 63); }
+  void reset(uint32_t cell) {
+    words[cell >> 6] &= ~(uint64_t(1) << (cell & 63));
+  }
+
+  /**
+   * @brief Empties the set.
+   */
+  void clear();
+
+  /**
+   * @brief Empties the set and changes the number of tiles.
+   *
+   * @param cells Number of tiles.
+   */
+  void resize(size_t cells);
+
+  /**
+   * @brief Tests many tiles at once.
+   *
+   * Uses AVX2 gathers when the CPU supports them, plain word lookups
+   * otherwise.
+   *
+   * @param cells The tiles to test.
+   * @param count Number of tiles.
+   * @param hits Set to 1 for every tile in the set, 0 otherwise.
+   */
+  void test_many(const uint32_t *cells, size_t count, uint8_t *hits) const;
+
+private:
+  std::vector<uint64_t> words;
+};
+
+#endif // BITBOARD_HPP
@@ -0,0 +1,69 @@
+#include "cluster.hpp"
+#include "server.hpp"
+#include <algorithm>
+
+Cluster::Cluster(int shard_count, int room_count, int pinned_rooms)
+    : shard_count(shard_count), room_sizes(room_count), room_open(room_count),
+      free_room_ids(shard_count) {
+  for (int i = 0; i < room_count; i++) {
+    room_sizes[i].store(0, std::memory_order_relaxed);
+    room_open[i].store(i < pinned_rooms, std::memory_order_relaxed);
+  }
+  open_rooms.store(std::min(pinned_rooms, room_count),
+                   std::memory_order_relaxed);
+
+  // highest ids first, so the lowest free id is at the back
+  for (int i = room_count - 1; i >= pinned_rooms; i--) {
+    free_room_ids[room_owner(i)].push_back(i);
+  }
+}
+
+int Cluster::room_owner(int room_id) const { return room_id % shard_count; }
+
+int Cluster::open_room(int shard) {
+  std::lock_guard<std::mutex> lock(rooms_mutex);
+  std::vector<int> &free_ids = free_room_ids[shard];
+  if (free_ids.empty())
+    return -1;
+  int room_id = free_ids.back();
+  free_ids.pop_back();
+  room_open[room_id].store(true, std::memory_order_relaxed);
+  open_rooms.fetch_add(1, std::memory_order_relaxed);
+  return room_id;
+}
+
+void Cluster::close_room(int room_id) {
+  std::lock_guard<std::mutex> lock(rooms_mutex);
+  room_open[room_id].store(false, std::memory_order_relaxed);
+  open_rooms.fetch_sub(1, std::memory_order_relaxed);
+  free_room_ids[room_owner(room_id)].push_back(room_id);
+}
+
+bool Cluster::room_is_open(int room_id) const {
+  return room_id >= 0 && room_id < static_cast<int>(room_open.size()) &&
+         room_open[room_id].load(std::memory_order_relaxed);
+}
+
+int Cluster::claim_nick(const std::string &nick, int shard) {
+  std::lock_guard<std::mutex> lock(directory_mutex);
+  auto res = nick_owner.emplace(nick, shard);
+  return res.first->second;
+}
+
+void Cluster::release_nick(const std::string &nick, int shard) {
+  std::lock_guard<std::mutex> lock(directory_mutex);
+  auto it = nick_owner.find(nick);
+  if (it != nick_owner.end() && it->second == shard) {
+    nick_owner.erase(it);
+  }
+}
+
+void Cluster::handoff(int shard, Handoff handoff) {
+  // the directory lock is held while queueing, so the handoff is delivered
+  // before any NICK routed to the target after the ownership change
+  std::lock_guard<std::mutex> lock(directory_mutex);
+  if (handoff.player) {
+    nick_owner[handoff.player->nickname] = shard;
+  }
+  shards[shard]->receive_handoff(std::move(handoff));
+}
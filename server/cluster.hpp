@@ -0,0 +1,118 @@
+#ifndef CLUSTER_HPP
+#define CLUSTER_HPP
+
+#include "connection.hpp"
+#include "player.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Server;
+
+/**
+ * @brief A connection (and possibly its player) moved between reactors.
+ */
+struct Handoff {
+  std::unique_ptr<Connection> conn; ///< The migrating connection.
+  std::unique_ptr<Player> player;   ///< Its player, if owned by the sender.
+  Request request; ///< Message to replay on the receiving reactor.
+};
+
+/**
+ * @brief State shared between the reactors of a multi-reactor server.
+ *
+ * Every reactor (Server instance) owns its connections, players and rooms
+ * and runs on its own thread. The cluster only holds what is needed to
+ * route clients to the reactor owning their room or player, none of it is
+ * touched on the game tick path.
+ */
+class Cluster {
+public:
+  /**
+   * @brief Construct a new Cluster object.
+   *
+   * @param shard_count Number of reactors.
+   * @param room_count Maximum number of rooms shared among the reactors.
+   * @param pinned_rooms Number of rooms, starting at id 0, that are always
+   * open.
+   */
+  Cluster(int shard_count, int room_count, int pinned_rooms);
+
+  /**
+   * @brief Get the reactor owning a room.
+   *
+   * @param room_id The room identifier.
+   * @return int Index of the owning reactor.
+   */
+  int room_owner(int room_id) const;
+
+  /**
+   * @brief Opens a room owned by the given reactor.
+   *
+   * @param shard The reactor that will own the room.
+   * @return int The room id, -1 if the reactor has no free ids left.
+   */
+  int open_room(int shard);
+
+  /**
+   * @brief Closes a room, its id can be handed out again.
+   *
+   * @param room_id The room identifier, not a pinned room.
+   */
+  void close_room(int room_id);
+
+  /**
+   * @brief Checks whether a room is open.
+   *
+   * @param room_id The room identifier.
+   * @return bool Whether the room id is in range and open.
+   */
+  bool room_is_open(int room_id) const;
+
+  /**
+   * @brief Claims a nickname for a reactor unless another one owns it.
+   *
+   * @param nick The nickname to claim.
+   * @param shard The reactor claiming the nickname.
+   * @return int The reactor owning the nickname after the call.
+   */
+  int claim_nick(const std::string &nick, int shard);
+
+  /**
+   * @brief Releases a nickname if it is owned by the given reactor.
+   *
+   * @param nick The nickname to release.
+   * @param shard The reactor releasing the nickname.
+   */
+  void release_nick(const std::string &nick, int shard);
+
+  /**
+   * @brief Passes a connection to another reactor.
+   *
+   * Ownership of a migrating player's nickname is moved together with the
+   * handoff, so a later NICK routed to the target always finds the player.
+   *
+   * @param shard The target reactor.
+   * @param handoff The connection, player and message to replay.
+   */
+  void handoff(int shard, Handoff handoff);
+
+  int shard_count;             ///< Number of reactors.
+  std::vector<Server *> shards; ///< Reactors indexed by shard id.
+  std::vector<std::atomic<int>> room_sizes; ///< Player count of each room.
+  std::vector<std::atomic<bool>> room_open;  ///< Whether a room is open.
+  std::atomic<int> open_rooms;               ///< Number of open rooms.
+
+private:
+  std::mutex rooms_mutex;
+  std::vector<std::vector<int>> free_room_ids; ///< Closed ids per reactor.
+
+  std::mutex directory_mutex;
+  std::unordered_map<std::string, int> nick_owner; ///< Nickname to reactor.
+};
+
+#endif // CLUSTER_HPP
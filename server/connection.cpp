@@ -2,8 +2,12 @@
 #include <arpa/inet.h>
 
 Connection::Connection(int socket, sockaddr_in addr)
-    : socket(socket), addr(addr), player(nullptr),
-      last_active(std::chrono::steady_clock::now()) {}
+    : socket(socket), addr(addr), out_offset(0), out_bytes(0),
+      want_write(false),
+      send_in_flight(false), recv_armed(false), recv_cancelled(false),
+      generation(0), closing(false), migrate_to(-1),
+      delta_ticks(false), binary(false), need_keyframe(false), watching(-1),
+      watch_every(1), watch_slot(0), player(nullptr), timeout(this) {}
 
 std::string Connection::get_name() {
   if (player) {
@@ -14,3 +18,48 @@ std::string Connection::get_name() {
   int client_port = ntohs(addr.sin_port);
   return std::string(client_ip) + ":" + std::to_string(client_port);
 }
+
+size_t Connection::backlog() const { return out_bytes - out_offset; }
+
+void Connection::queue(MessageRef msg) {
+  out_bytes += msg.size();
+  out_queue.push_back(std::move(msg));
+}
+
+int Connection::gather(iovec *iov, int max) const {
+  int count = 0;
+  size_t offset = out_offset;
+  for (auto it = out_queue.begin(); it != out_queue.end() && count < max;
+       ++it) {
+    iov[count].iov_base = const_cast<char *>(it->data()) + offset;
+    iov[count].iov_len = it->size() - offset;
+    offset = 0;
+    count++;
+  }
+  return count;
+}
+
+void Connection::consume(size_t bytes) {
+  out_offset += bytes;
+  while (!out_queue.empty() && out_offset >= out_queue.front().size()) {
+    out_offset -= out_queue.front().size();
+    out_bytes -= out_queue.front().size();
+    out_queue.pop_front();
+  }
+}
+
+void Connection::detach_queue() {
+  if (out_queue.empty())
+    return;
+  std::string data;
+  data.reserve(backlog());
+  size_t offset = out_offset;
+  for (const MessageRef &msg : out_queue) {
+    data.append(msg.data() + offset, msg.size() - offset);
+    offset = 0;
+  }
+  out_queue.clear();
+  out_offset = 0;
+  out_bytes = 0;
+  queue(MessageRef::unpooled(std::move(data)));
+}
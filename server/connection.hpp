@@ -1,10 +1,19 @@
 #ifndef CONNECTION_HPP
 #define CONNECTION_HPP
 
+#include "input_buffer.hpp"
+#include "message.hpp"
 #include "player.hpp"
-#include <chrono>
+#include "protocol.hpp"
+#include "timing_wheel.hpp"
+#include <cstdint>
+#include <deque>
 #include <netinet/in.h>
 #include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define SEND_IOV_MAX 16
 
 /**
  * @brief Represents a client connection to the server.
@@ -30,12 +39,68 @@ public:
    */
   std::string get_name();
 
+  /**
+   * @brief Get the number of bytes queued but not yet written to the socket.
+   *
+   * @return size_t The size of the send backlog.
+   */
+  size_t backlog() const;
+
+  /**
+   * @brief Appends a message to the output queue.
+   *
+   * @param msg The message to send.
+   */
+  void queue(MessageRef msg);
+
+  /**
+   * @brief Describes the start of the output queue for a gathered write.
+   *
+   * @param iov Array to fill in.
+   * @param max Capacity of the array.
+   * @return int Number of filled entries.
+   */
+  int gather(iovec *iov, int max) const;
+
+  /**
+   * @brief Drops bytes written to the socket from the output queue.
+   *
+   * @param bytes Number of bytes written.
+   */
+  void consume(size_t bytes);
+
+  /**
+   * @brief Replaces the queued messages with a single unpooled copy.
+   *
+   * Needed before the connection moves to another reactor, pooled messages
+   * must be released on the reactor owning the pool.
+   */
+  void detach_queue();
+
   int socket;       ///< Socket file descriptor.
   sockaddr_in addr; ///< Client address information.
-  std::string buff; ///< Input buffer for received data.
+  InputBuffer input; ///< Received data not yet processed.
+  std::deque<MessageRef> out_queue; ///< Messages waiting to be sent.
+  size_t out_offset; ///< Bytes of the first queued message already sent.
+  size_t out_bytes;  ///< Total size of the queued messages.
+  iovec send_iov[SEND_IOV_MAX]; ///< Pending io_uring send.
+  msghdr send_hdr;              ///< Pending io_uring send.
+  bool want_write;      ///< Whether EPOLLOUT is registered for the socket.
+  bool send_in_flight;  ///< Whether an io_uring send is pending.
+  bool recv_armed;      ///< Whether an io_uring multishot receive is active.
+  bool recv_cancelled;  ///< Whether the receive has been asked to stop.
+  uint32_t generation;  ///< Distinguishes completions of a reused fd.
+  bool closing;         ///< Connection is scheduled to be closed.
+  int migrate_to;          ///< Reactor to hand the connection to, -1 if none.
+  Request migrate_req;     ///< Message to replay on the target reactor.
+  bool delta_ticks;   ///< Client asked for KEYF/DLTA instead of TICK.
+  bool binary;        ///< Client switched to binary frames.
+  bool need_keyframe; ///< Send a keyframe on the next tick.
+  int watching;       ///< Room watched as a spectator, -1 if none.
+  int watch_every;    ///< Spectator gets every nth tick.
+  size_t watch_slot;  ///< Position in the watched room's spectators.
   Player *player;   ///< Pointer to associated Player object (if any).
-  std::chrono::steady_clock::time_point
-      last_active; ///< Timestamp of last message.
+  TimerNode<Connection> timeout; ///< Closes the connection when inactive.
 };
 
 #endif // CONNECTION_HPP
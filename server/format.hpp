@@ -0,0 +1,64 @@
+#ifndef FORMAT_HPP
+#define FORMAT_HPP
+
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Helpers appending text replies to a buffer without temporary strings.
+ *
+ * The buffers are the pooled message buffers, which keep their capacity
+ * between uses, so once they have grown to the size of the largest reply
+ * nothing here allocates.
+ */
+
+/**
+ * @brief Appends a string literal, its length known at compile time.
+ *
+ * @param out Buffer to append to.
+ * @param text The literal.
+ */
+template <size_t N>
+inline void append_literal(std::string &out, const char (&text)[N]) {
+  out.append(text, N - 1);
+}
+
+/**
+ * @brief Appends an integer in decimal.
+ *
+ * @param out Buffer to append to.
+ * @param value The integer.
+ */
+template <typename T> inline void append_int(std::string &out, T value) {
+  static_assert(std::is_integral<T>::value, "append_int takes integers");
+  char digits[24];
+  auto result = std::to_chars(digits, digits + sizeof(digits), value);
+  out.append(digits, result.ptr - digits);
+}
+
+/**
+ * @brief Appends a space separated field.
+ *
+ * @param out Buffer to append to.
+ * @param text The field.
+ */
+inline void append_field(std::string &out, std::string_view text) {
+  out += ' ';
+  out += text;
+}
+
+/**
+ * @brief Appends a space separated integer field.
+ *
+ * @param out Buffer to append to.
+ * @param value The integer.
+ */
+template <typename T> inline void append_int_field(std::string &out, T value) {
+  out += ' ';
+  append_int(out, value);
+}
+
+#endif // FORMAT_HPP
@@ -1,10 +1,42 @@
 #include "game.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "protocol.hpp"
 #include <algorithm>
-#include <iostream>
 #include <vector>
 
-Game::Game() : active(false) {
-  grid.fill({});
+#define PRINT_LIMIT 32
+
+/**
+ * @brief Board of a size known at compile time, bounds checks and tile
+ * indexes fold into constants.
+ */
+template <int N> struct FixedBoard {
+  explicit FixedBoard(int) {}
+  bool inside(Position pos) const {
+    return static_cast<unsigned>(pos.x) < N && static_cast<unsigned>(pos.y) < N;
+  }
+  uint32_t cell(Position pos) const { return pos.y * N + pos.x; }
+};
+
+/**
+ * @brief Board of any size.
+ */
+struct DynamicBoard {
+  explicit DynamicBoard(int size) : size(size) {}
+  bool inside(Position pos) const {
+    return static_cast<unsigned>(pos.x) < static_cast<unsigned>(size) &&
+           static_cast<unsigned>(pos.y) < static_cast<unsigned>(size);
+  }
+  uint32_t cell(Position pos) const { return pos.y * size + pos.x; }
+  int size;
+};
+
+Game::Game()
+    : active(false), tick_seq(0), id(-1), slot(0), tick_ms(0), next_tick(0),
+      heap_index(SIZE_MAX),
+      initial_length(INITIAL_SNAKE_LENGTH) {
+  this->configure(DEFAULT_GRID_SIZE);
   dir_to_pos = {
       Position{0, -1}, // UP
       Position{0, 1},  // DOWN
@@ -14,15 +46,18 @@ Game::Game() : active(false) {
 }
 
 void Game::print() {
+  if (!LOG_ENABLED(LEVEL_DEBUG))
+    return;
   // ANSI color codes for up to 6 players
   const char *colors[] = {"\033[31m", "\033[32m", "\033[33m",
                           "\033[34m", "\033[35m", "\033[36m"};
   const char *reset = "\033[0m";
-  char field[GRID_SIZE][GRID_SIZE];
+  if (size > PRINT_LIMIT) {
+    LOG_DEBUG("(" << size << "x" << size << " board)");
+    return;
+  }
   // Fill field with empty
-  for (int y = 0; y < GRID_SIZE; ++y)
-    for (int x = 0; x < GRID_SIZE; ++x)
-      field[y][x] = '.';
+  std::vector<std::string> field(size, std::string(size, '.'));
 
   // Place apple
   field[apple.y][apple.x] = 'A';
@@ -32,59 +67,192 @@ void Game::print() {
   for (Player *player : players) {
     if (!player->alive)
       continue;
-    for (const Position &part : player->body) {
+    for (Position part : player->body) {
       field[part.y][part.x] = '0' + pid;
     }
     pid++;
   }
 
-  // Print player names in their color
+  // Log player names in their color
+  std::string line;
   pid = 0;
   for (Player *player : players) {
     if (!player->alive)
       continue;
-    std::cout << colors[pid % 6] << player->nickname << reset << " ";
+    line += colors[pid % 6];
+    line += player->nickname;
+    line += reset;
+    line += ' ';
     pid++;
   }
-  std::cout << std::endl;
+  LOG_DEBUG(line);
 
-  // Print field with colors
-  for (int y = 0; y < GRID_SIZE; ++y) {
-    for (int x = 0; x < GRID_SIZE; ++x) {
+  // Log field with colors, a line per row
+  for (int y = 0; y < size; ++y) {
+    line.clear();
+    for (int x = 0; x < size; ++x) {
       char c = field[y][x];
       if (c == 'A') {
-        std::cout << "\033[41mA" << reset;
+        line += "\033[41mA";
+        line += reset;
       } else if (c >= '0' && c <= '5') {
-        std::cout << colors[c - '0'] << c << reset;
+        line += colors[c - '0'];
+        line += c;
+        line += reset;
       } else {
-        std::cout << c;
+        line += c;
       }
     }
-    std::cout << std::endl;
+    LOG_DEBUG(line);
   }
 };
 
-bool Game::is_empty(Position pos) {
-  bool tile_is_full = false;
-  for (Player *player : players) {
-    for (auto part : player->body) {
-      if (pos.x == part.x && pos.y == part.y) {
-        tile_is_full = true;
-      }
-    }
+void Game::reset() {
+  this->match_log.finish();
+  this->drain_inputs();
+  for (Player *player : this->players) {
+    player->body.detach();
+  }
+  this->players.clear();
+  this->active = false;
+  this->tick_seq = 0;
+  this->id = -1;
+  this->initial_length = INITIAL_SNAKE_LENGTH;
+  if (size != DEFAULT_GRID_SIZE)
+    this->configure(DEFAULT_GRID_SIZE);
+}
+
+void Game::configure(int size) {
+  this->size = size;
+
+  size_t cells = static_cast<size_t>(size) * size;
+  grid.resize(cells);
+  heads_seen.resize(cells);
+  heads_shared.resize(cells);
+  free_cells.assign(cells, 0);
+  free_cells.shrink_to_fit();
+  free_slot.assign(cells, 0);
+  free_slot.shrink_to_fit();
+  body_arena.clear();
+  body_arena.shrink_to_fit();
+  link_arena.clear();
+  link_arena.shrink_to_fit();
+  this->clear_grid();
+
+  switch (size) {
+  case 10:
+    kernel = &Game::slither_on<FixedBoard<10>>;
+    break;
+  case 32:
+    kernel = &Game::slither_on<FixedBoard<32>>;
+    break;
+  case 64:
+    kernel = &Game::slither_on<FixedBoard<64>>;
+    break;
+  default:
+    kernel = &Game::slither_on<DynamicBoard>;
+    break;
+  }
+}
+
+void Game::add_player(Player *player) {
+  this->players.push_back(player);
+  if (match_log.is_open())
+    match_log.join(*player);
+}
+
+void Game::remove_player(Player *player) {
+  this->drain_inputs();
+  if (match_log.is_open()) {
+    int index = this->player_id(player);
+    if (index >= 0)
+      match_log.leave(index);
   }
-  return !tile_is_full;
+  this->players.remove(player);
+  // a snake without a body must not take part in another game's tick
+  player->alive = false;
+  player->body.detach();
+}
+
+int Game::push_input(const Input &input) { return !inputs.push(input); }
+
+void Game::acknowledge(Player *player) { player->acked.store(true); }
+
+void Game::drain_inputs() {
+  for (Player *player : this->players) {
+    if (player->acked.exchange(false))
+      player->updated = true;
+  }
+  Input input;
+  while (inputs.pop(input)) {
+    Player *player = input.player;
+    // a snake cannot turn back into itself
+    if (input.dir != opposite(player->last_move_dir))
+      player->dir = input.dir;
+  }
+}
+
+bool Game::is_empty(Position pos) { return !grid.test(cell_of(pos)); }
+
+void Game::clear_grid() {
+  grid.clear();
+  stacked.clear();
+  for (size_t i = 0; i < free_cells.size(); i++) {
+    free_cells[i] = i;
+    free_slot[i] = i;
+  }
+  free_count = free_cells.size();
+}
+
+void Game::occupy(uint32_t cell) {
+  if (grid.test(cell)) {
+    stacked.push_back(cell);
+    return;
+  }
+  grid.set(cell);
+  // swap the tile with the last empty one and shrink the set
+  uint32_t last = free_cells[--free_count];
+  free_cells[free_slot[cell]] = last;
+  free_slot[last] = free_slot[cell];
+}
+
+void Game::vacate(uint32_t cell) {
+  auto extra = std::find(stacked.begin(), stacked.end(), cell);
+  if (extra != stacked.end()) {
+    *extra = stacked.back();
+    stacked.pop_back();
+    return;
+  }
+  grid.reset(cell);
+  free_slot[cell] = free_count;
+  free_cells[free_count++] = cell;
 }
 
 bool Game::slither() {
+  if (match_log.is_open())
+    match_log.tick(players);
+  bool game_continues = (this->*kernel)();
+  if (!game_continues)
+    match_log.finish();
+  return game_continues;
+}
+
+template <typename Board> bool Game::slither_on() {
+  Board board(size);
+  this->tick_seq++;
+  for (Player *player : this->players) {
+    player->moved = false;
+    player->tail_popped = false;
+  }
+
   // are there enought players for the game to continue?
   if (std::count_if(this->players.begin(), this->players.end(),
                     [](Player *p) { return p->alive; }) < 2) {
     return false;
   }
 
-  // newly occupied tiles
-  std::vector<Position> snake_heads;
+  movers.clear();
+  head_cells.clear();
 
   // advance the snakes, kill if out of bounds
   for (Player *player : this->players) {
@@ -93,39 +261,39 @@ bool Game::slither() {
       continue;
     player->updated = false;
     Position pos = player->body.front() + this->dir_to_pos[player->dir];
-    if (pos.x < 0 || pos.x >= GRID_SIZE || pos.y < 0 || pos.y >= GRID_SIZE) {
+    if (!board.inside(pos)) {
       player->alive = false;
     } else {
-      snake_heads.push_back(pos);
-      player->body.push_front(pos);
+      movers.push_back(player);
+      head_cells.push_back(board.cell(pos));
+      player->body.push_front(pos, player->dir);
+      player->moved = true;
       player->last_move_dir = player->dir;
     }
   }
 
-  // check for colisions
-  for (Player *player : this->players) {
-    Position pos = player->body.front();
-    if (grid[pos.y][pos.x]) {
-      player->alive = false;
-    };
-  }
+  // check for colisions with the bodies as they were before the tick
+  head_hits.resize(head_cells.size());
+  grid.test_many(head_cells.data(), head_cells.size(), head_hits.data());
 
-  // check for head to head colisions
-  for (Player *outer : this->players) {
-    if (!outer->alive)
-      continue;
-    for (Player *inner : this->players) {
-      if (outer != inner && inner->alive &&
-          outer->body.front() == inner->body.front()) {
-        outer->alive = false;
-        inner->alive = false;
-      }
-    }
+  // check for head to head colisions, the second head on a tile marks it
+  for (uint32_t cell : head_cells) {
+    if (heads_seen.test(cell))
+      heads_shared.set(cell);
+    heads_seen.set(cell);
+  }
+  for (size_t i = 0; i < movers.size(); i++) {
+    if (head_hits[i] || heads_shared.test(head_cells[i]))
+      movers[i]->alive = false;
+  }
+  for (uint32_t cell : head_cells) {
+    heads_seen.reset(cell);
+    heads_shared.reset(cell);
   }
 
   // set colision tiles under new heads
-  for (Position head : snake_heads) {
-    grid[head.y][head.x] = true;
+  for (uint32_t cell : head_cells) {
+    this->occupy(cell);
   }
 
   // remove tail of snakes who did not eat the apple
@@ -136,14 +304,14 @@ bool Game::slither() {
       player->length++;
       apple_eaten = true;
     } else if ((int)player->body.size() > player->length) {
-      Position pos = player->body.back();
-      grid[pos.y][pos.x] = false;
+      this->vacate(board.cell(player->body.back()));
       player->body.pop_back();
+      player->tail_popped = true;
     }
   }
 
-  // respawn the apple if eaten
-  if (apple_eaten) {
+  // respawn the apple if eaten, it stays put on a full board
+  if (apple_eaten && free_count > 0) {
     this->apple = random_empty_tile();
   }
 
@@ -157,72 +325,166 @@ bool Game::slither() {
 }
 
 Position Game::random_empty_tile() {
-  Position pos;
-  do {
-    pos = {std::rand() % GRID_SIZE, std::rand() % GRID_SIZE};
-  } while (!is_empty(pos));
-  return pos;
+  uint32_t cell = free_cells[rng.below(free_count)];
+  return {static_cast<int>(cell % size), static_cast<int>(cell / size)};
 };
 
-int Game::hatch() {
+int Game::hatch(uint64_t seed) {
   if (this->players.size() < 2 || this->active) {
     return 1;
   }
+  this->rng.seed(seed);
+  // inputs sent in the lobby only matter as acknowledgements
+  this->drain_inputs();
 
-  for (auto &row : this->grid) {
-    row.fill(false);
-  }
+  this->clear_grid();
+
+  // every snake gets room for the whole board plus a head crashed into it,
+  // so the ticks never allocate
+  size_t stride = free_cells.size() + 1;
+  body_arena.resize(players.size() * stride);
+  link_arena.resize(players.size() * stride);
+  size_t offset = 0;
 
   for (Player *player : this->players) {
-    player->body.clear();
-    player->length = 3;
+    player->body.attach(&body_arena[offset], &link_arena[offset], stride);
+    offset += stride;
+    player->length = initial_length;
     Position pos = Game::random_empty_tile();
-    player->dir = static_cast<Direction>(std::rand() % 4);
+    player->dir = static_cast<Direction>(rng.below(DIRECTION_COUNT));
     player->body.push_front(pos);
-    grid[pos.y][pos.x] = true;
+    this->occupy(cell_of(pos));
     player->alive = true;
   }
 
   this->apple = random_empty_tile();
   this->active = true;
+  this->tick_seq = 0;
   return 0;
 }
 
+int Game::record(const std::string &path, uint64_t seed) {
+  return match_log.open(path, seed, size, initial_length, players);
+}
+
 std::string Game::current_move() {
   std::string move_str = "";
-  move_str +=
-      std::to_string(this->apple.x) + " " + std::to_string(this->apple.y);
+  append_int(move_str, this->apple.x);
+  append_int_field(move_str, this->apple.y);
   for (auto player : this->players) {
-    move_str += " " + player->nickname + " " + dir_to_string(player->dir);
+    append_field(move_str, player->nickname);
+    move_str += ' ';
+    move_str += dir_to_char(player->dir);
   }
   return move_str;
 }
 
 std::string Game::full_state() {
   std::string state_str = "";
-  state_str +=
-      std::to_string(this->apple.x) + " " + std::to_string(this->apple.y);
+  full_state(state_str);
+  return state_str;
+}
+
+void Game::full_state(std::string &state_str) {
+  append_int(state_str, this->apple.x);
+  append_int_field(state_str, this->apple.y);
   for (auto player : this->players) {
     if (player->body.size() == 0)
       continue;
-    state_str += " " + player->nickname + " " +
-                 std::to_string(player->body.front().x) + " " +
-                 std::to_string(player->body.front().y) + " ";
+    append_field(state_str, player->nickname);
+    append_int_field(state_str, player->body.front().x);
+    append_int_field(state_str, player->body.front().y);
+    state_str += ' ';
 
     state_str += player->alive
-                     ? "H"
-                     : "E"; // H for head if the player only has head so far;
-    Position last_body_part = player->body.front();
-    for (auto body_part : player->body) {
-      if (last_body_part == body_part)
-        continue;
-      for (int dir = 0; dir < DIRECTION_COUNT; ++dir) {
-        if (dir_to_pos[dir] == body_part - last_body_part) {
-          state_str += dir_to_string(static_cast<Direction>(dir));
-        };
+                     ? 'H'
+                     : 'E'; // H for head if the player only has head so far;
+    player->body.append_links(state_str);
+  }
+}
+
+void Game::delta_state(std::string &state_str) {
+  append_int(state_str, this->apple.x);
+  append_int_field(state_str, this->apple.y);
+  for (auto player : this->players) {
+    if (player->body.size() == 0)
+      continue;
+    append_field(state_str, player->nickname);
+    state_str += ' ';
+    state_str += player->moved ? dir_to_char(player->last_move_dir) : '-';
+    state_str += player->tail_popped ? 'T' : '-';
+    state_str += player->alive ? 'H' : 'E';
+  }
+}
+
+int Game::full_state_binary(std::string &out) {
+  put_u16(out, this->apple.x);
+  put_u16(out, this->apple.y);
+  size_t count_at = out.size();
+  put_u8(out, 0);
+  uint8_t count = 0;
+  uint8_t id = 0;
+  for (auto player : this->players) {
+    uint8_t player_id = id++;
+    if (player->body.size() == 0)
+      continue;
+    if (player->body.size() - 1 > 0xffff)
+      return 1;
+    count++;
+    put_u8(out, player_id);
+    put_u8(out, player->alive ? 0 : 1);
+    put_u16(out, player->body.front().x);
+    put_u16(out, player->body.front().y);
+    put_u16(out, player->body.size() - 1);
+
+    uint8_t packed = 0;
+    int packed_count = 0;
+    for (size_t i = 1; i < player->body.size(); i++) {
+      packed |= char_to_dir(player->body.link(i)) << (6 - 2 * packed_count);
+      if (++packed_count == 4) {
+        put_u8(out, packed);
+        packed = 0;
+        packed_count = 0;
       }
-      last_body_part = body_part;
     }
+    if (packed_count)
+      put_u8(out, packed);
   }
-  return state_str;
+  out[count_at] = static_cast<char>(count);
+  return 0;
+}
+
+void Game::delta_state_binary(std::string &out) {
+  put_u16(out, this->apple.x);
+  put_u16(out, this->apple.y);
+  size_t count_at = out.size();
+  put_u8(out, 0);
+  uint8_t count = 0;
+  uint8_t id = 0;
+  for (auto player : this->players) {
+    uint8_t player_id = id++;
+    if (player->body.size() == 0)
+      continue;
+    count++;
+    uint8_t flags = 0;
+    if (player->moved)
+      flags |= player->last_move_dir | 1 << 2;
+    if (player->tail_popped)
+      flags |= 1 << 3;
+    if (!player->alive)
+      flags |= 1 << 4;
+    put_u8(out, player_id);
+    put_u8(out, flags);
+  }
+  out[count_at] = static_cast<char>(count);
+}
+
+int Game::player_id(Player *player) {
+  int id = 0;
+  for (Player *p : this->players) {
+    if (p == player)
+      return id;
+    id++;
+  }
+  return -1;
 }
@@ -1,24 +1,92 @@
 #ifndef GAME_HPP
 #define GAME_HPP
 
+#include "bitboard.hpp"
+#include "match_log.hpp"
+#include "mpsc_queue.hpp"
 #include "player.hpp"
+#include "rng.hpp"
 #include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdint>
 #include <list>
 #include <string>
+#include <vector>
+
+class Connection;
+
+#define INPUT_QUEUE_SIZE 256
+#define DEFAULT_GRID_SIZE 10
+#define MIN_GRID_SIZE 5
+#define MAX_GRID_SIZE 1024
+#define MIN_INITIAL_LENGTH 1
+/// Match logs store the initial length in a byte.
+#define MAX_INITIAL_LENGTH 255
+
+/**
+ * @brief A player's move waiting for the next tick of its room.
+ */
+struct Input {
+  Player *player;
+  Direction dir; ///< Requested direction.
+};
 
 /**
  * @brief Manages the state and logic of a single game room.
  */
 class Game {
-  std::array<std::array<bool, GRID_SIZE>, GRID_SIZE> grid;
+  /// Tiles with a snake part, dead snakes included.
+  Bitboard grid;
+  /// Tiles holding more than one part, once per extra part. Bodies only
+  /// overlap where a snake crashed, so this stays tiny.
+  std::vector<uint32_t> stacked;
+  /// Indexes of the empty tiles in no particular order.
+  std::vector<uint32_t> free_cells;
+  /// Position of each empty tile in free_cells.
+  std::vector<uint32_t> free_slot;
+  size_t free_count; ///< Number of empty tiles.
+  /// Storage of the snake bodies, one ring per player of the game.
+  std::vector<PackedPosition> body_arena;
+  /// Links of the snake bodies, laid out like body_arena.
+  std::vector<char> link_arena;
+  /// slither specialized for the board size.
+  bool (Game::*kernel)();
   std::array<Position, Direction::DIRECTION_COUNT> dir_to_pos;
+  MpscQueue<Input, INPUT_QUEUE_SIZE> inputs;
+  Rng rng; ///< Seeded by hatch, the only source of randomness of a match.
+
+  // scratch space of slither, kept to avoid allocating every tick
+  std::vector<Player *> movers;     ///< Snakes whose head stayed inside.
+  std::vector<uint32_t> head_cells; ///< New head tile of each mover.
+  std::vector<uint8_t> head_hits;   ///< Whether the tile was occupied.
+  Bitboard heads_seen;              ///< Tiles reached by a head.
+  Bitboard heads_shared;            ///< Tiles reached by several heads.
+
+  /**
+   * @brief Advances the game by one tick, see slither.
+   *
+   * @tparam Board Bounds and tile indexing, fixed for the common sizes.
+   * @return true If the game continues.
+   */
+  template <typename Board> bool slither_on();
 
 public:
   std::list<Player *> players; ///< List of players currently in the room.
+  /// Connections watching the room, they do not take part in the game.
+  std::vector<Connection *> spectators;
   bool active;                 ///< Whether the game is currently ongoing.
   bool waiting;                ///< Whether the game is waiting for players.
   Position apple;              ///< Position of the apple.
+  uint32_t tick_seq;           ///< Number of ticks since the game started.
+  int id;                      ///< Room identifier.
+  size_t slot;                 ///< Position in the reactor's open rooms.
+  int tick_ms;                 ///< Tick interval in milliseconds.
+  uint64_t next_tick;          ///< Deadline of the next tick in nanoseconds.
+  size_t heap_index;           ///< Position in the tick scheduler.
+  int size;                    ///< Width and height of the board.
+  int initial_length;          ///< Length of the snakes at the start.
+  MatchLog match_log;          ///< Record of the running match, if any.
 
   /**
    * @brief Construct a new Game object.
@@ -27,6 +95,76 @@ public:
    */
   Game();
 
+  /**
+   * @brief Empties the room so the object can be reused for another room.
+   *
+   * The board and the snakes go back to the default size.
+   */
+  void reset();
+
+  /**
+   * @brief Sets the board size of a room without a running game.
+   *
+   * Sizes 10, 32 and 64 get a slither compiled for them, others use a
+   * generic one.
+   *
+   * @param size Width and height, MIN_GRID_SIZE to MAX_GRID_SIZE.
+   */
+  void configure(int size);
+
+  /**
+   * @brief Get the index of a tile.
+   *
+   * @param pos The tile, inside the grid.
+   * @return uint32_t The index, y * size + x.
+   */
+  uint32_t cell_of(Position pos) const { return pos.y * size + pos.x; }
+
+  /**
+   * @brief Adds a player to the room, as the last one.
+   *
+   * @param player The player, not in a room.
+   */
+  void add_player(Player *player);
+
+  /**
+   * @brief Removes a player from the room.
+   *
+   * Applies the queued inputs first and detaches the body from the room's
+   * storage.
+   *
+   * @param player The player, in the room.
+   */
+  void remove_player(Player *player);
+
+  /**
+   * @brief Queues a player's move for the next tick.
+   *
+   * Safe to call from any thread.
+   *
+   * @param input The move, its player must be in the room.
+   * @return int 0 on success, 1 if INPUT_QUEUE_SIZE moves already wait.
+   */
+  int push_input(const Input &input);
+
+  /**
+   * @brief Marks a player as having acknowledged the last tick.
+   *
+   * Safe to call from any thread, never fails.
+   *
+   * @param player The player, in the room.
+   */
+  void acknowledge(Player *player);
+
+  /**
+   * @brief Applies the acknowledgements, then the queued moves in the
+   * order they arrived.
+   *
+   * Called by the thread running the room before each tick and before a
+   * player leaves, so no queued input outlives its player.
+   */
+  void drain_inputs();
+
   /**
    * @brief Checks if a position on the grid is empty.
    *
@@ -37,7 +175,27 @@ public:
   bool is_empty(Position pos);
 
   /**
-   * @brief Prints the current game state to the console, only for debug.
+   * @brief Marks every tile as empty.
+   */
+  void clear_grid();
+
+  /**
+   * @brief Adds a snake part to a tile.
+   *
+   * @param cell The tile index.
+   */
+  void occupy(uint32_t cell);
+
+  /**
+   * @brief Removes a snake part from a tile.
+   *
+   * @param cell The tile index.
+   */
+  void vacate(uint32_t cell);
+
+  /**
+   * @brief Logs the current game state at debug level, returns right
+   * away when it is off.
    */
   void print();
 
@@ -47,15 +205,28 @@ public:
    * Resets snakes, places them randomly, and spawns the first apple,
    * sets the game as active
    *
+   * @param seed Seed of the room's generator, the same seed and inputs
+   * play the same match.
    * @return int 0 on success, 1 if not enough players or already active.
    */
-  int hatch();
+  int hatch(uint64_t seed);
+
+  /**
+   * @brief Starts recording the match that has just been hatched.
+   *
+   * The log is finished when the game ends or the room is reset.
+   *
+   * @param path The log file.
+   * @param seed Seed the game was hatched with.
+   * @return int 0 on success, 1 if the file could not be created.
+   */
+  int record(const std::string &path, uint64_t seed);
 
   /**
    * @brief Advances the game by one tick.
    *
    * Moves snakes, checks collisions, handles eating, and manages game end
-   * conditions.
+   * conditions. A recorded match logs the directions the snakes move in.
    *
    * @return true If the game continues.
    * @return false If the game ends (not enough players alive).
@@ -65,6 +236,8 @@ public:
   /**
    * @brief Finds a random empty tile on the grid.
    *
+   * At least one tile must be empty.
+   *
    * @return Position A random empty position.
    */
   Position random_empty_tile();
@@ -97,6 +270,62 @@ public:
    * @return std::string The encoded full state string.
    */
   std::string full_state();
+
+  /**
+   * @brief Appends the full state string of the game to a buffer.
+   *
+   * Same format as full_state().
+   *
+   * @param out The buffer to append to.
+   */
+  void full_state(std::string &out);
+
+  /**
+   * @brief Appends the changes made by the last tick to a buffer.
+   *
+   * Format: "ax ay [nick dts]..." where:
+   * - ax, ay: Apple coordinates
+   * - nick: Player nickname
+   * - d: Direction the head advanced (U, D, L, R), '-' if it did not move
+   * - t: 'T' if the tail was removed, '-' otherwise
+   * - s: 'H' (Alive), 'E' (Eliminated)
+   * example 1 2 nick1 UTH nick2 --E
+   *
+   * @param out The buffer to append to.
+   */
+  void delta_state(std::string &out);
+
+  /**
+   * @brief Appends the binary full state of the game to a buffer.
+   *
+   * Layout (big endian): u16 ax, u16 ay, u8 count, then per snake u8 id,
+   * u8 status (0 alive, 1 eliminated), u16 hx, u16 hy, u16 n and n body
+   * directions packed four to a byte, most significant bits first. The id
+   * is the index of the player in the room.
+   *
+   * @param out The buffer to append to.
+   * @return int 0 on success, 1 if a snake is too long for its u16 n.
+   */
+  int full_state_binary(std::string &out);
+
+  /**
+   * @brief Appends the binary changes made by the last tick to a buffer.
+   *
+   * Layout (big endian): u16 ax, u16 ay, u8 count, then per snake u8 id
+   * and u8 flags: bits 0-1 head direction, bit 2 head advanced, bit 3 tail
+   * removed, bit 4 eliminated.
+   *
+   * @param out The buffer to append to.
+   */
+  void delta_state_binary(std::string &out);
+
+  /**
+   * @brief Get the id of a player used by binary messages.
+   *
+   * @param player The player.
+   * @return int Index of the player in the room, -1 if not in the room.
+   */
+  int player_id(Player *player);
 };
 
 #endif // GAME_HPP
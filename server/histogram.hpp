@@ -0,0 +1,119 @@
+#ifndef HISTOGRAM_HPP
+#define HISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 48
+#define HISTOGRAM_BUCKETS                                                      \
+  (HISTOGRAM_SUB * (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1))
+
+/**
+ * @brief Log-linear histogram of non-negative integers, as in HDR
+ * histograms.
+ *
+ * Values below HISTOGRAM_SUB get a bucket each, above that every power of
+ * two is split into HISTOGRAM_SUB buckets, so a value is known within
+ * 12.5 % over the whole range up to 2^HISTOGRAM_MAX_BITS. Recording is a
+ * few instructions and never allocates.
+ *
+ * Only one thread may record, any thread may read at the same time. Reads
+ * taken while recording goes on may be off by the values being recorded.
+ */
+class Histogram {
+public:
+  /**
+   * @brief Get the bucket of a value.
+   *
+   * @param value The value, larger ones go to the last bucket.
+   * @return size_t Index below HISTOGRAM_BUCKETS.
+   */
+  static size_t bucket(uint64_t value) {
+    if (value < HISTOGRAM_SUB)
+      return value;
+    int exp = 63 - __builtin_clzll(value);
+    if (exp >= HISTOGRAM_MAX_BITS)
+      return HISTOGRAM_BUCKETS - 1;
+    return HISTOGRAM_SUB * (exp - HISTOGRAM_SUB_BITS + 1) +
+           (value >> (exp - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB;
+  }
+
+  /**
+   * @brief Get the smallest value of a bucket.
+   *
+   * @param index The bucket, HISTOGRAM_BUCKETS for the end of the range.
+   * @return uint64_t The value.
+   */
+  static uint64_t lower_bound(size_t index) {
+    if (index < HISTOGRAM_SUB)
+      return index;
+    int exp = index / HISTOGRAM_SUB + HISTOGRAM_SUB_BITS - 1;
+    return static_cast<uint64_t>(index % HISTOGRAM_SUB + HISTOGRAM_SUB)
+           << (exp - HISTOGRAM_SUB_BITS);
+  }
+
+  void record(uint64_t value) {
+    bump(counts[bucket(value)], 1);
+    bump(total, 1);
+    bump(sum_, value);
+    if (value > max_.load(std::memory_order_relaxed))
+      max_.store(value, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Adds the values of another histogram to this one.
+   *
+   * @param other The histogram, not recorded to meanwhile.
+   */
+  void merge(const Histogram &other) {
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+      bump(counts[i], other.at(i));
+    bump(total, other.count());
+    bump(sum_, other.sum());
+    if (other.max() > max())
+      max_.store(other.max(), std::memory_order_relaxed);
+  }
+
+  uint64_t at(size_t index) const {
+    return counts[index].load(std::memory_order_relaxed);
+  }
+  uint64_t count() const { return total.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Get a percentile.
+   *
+   * @param fraction The percentile, 0.5 for the median.
+   * @return uint64_t Smallest value of the bucket holding it, 0 if empty.
+   */
+  uint64_t percentile(double fraction) const {
+    uint64_t rank = std::ceil(fraction * count());
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      seen += at(i);
+      if (seen >= rank && seen > 0)
+        return lower_bound(i);
+    }
+    return 0;
+  }
+
+private:
+  // the only writer needs no atomic read-modify-write
+  static void bump(std::atomic<uint64_t> &value, uint64_t by) {
+    value.store(value.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+  }
+
+  std::array<std::atomic<uint64_t>, HISTOGRAM_BUCKETS> counts{};
+  std::atomic<uint64_t> total{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+#endif // HISTOGRAM_HPP
@@ -0,0 +1,39 @@
+#include "input_buffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+size_t InputBuffer::reserve() {
+  // only an incomplete message is left over, moving it is cheap
+  if (head > 0) {
+    memmove(storage.data(), storage.data() + head, tail - head);
+    tail -= head;
+    head = 0;
+  }
+  return storage.size() - tail;
+}
+
+int InputBuffer::append(const char *data, size_t len) {
+  if (reserve() < len)
+    return -1;
+  memcpy(write_ptr(), data, len);
+  commit(len);
+  return 0;
+}
+
+void InputBuffer::consume(size_t bytes) {
+  head += bytes;
+  if (head == tail)
+    head = tail = 0;
+}
+
+bool InputBuffer::refill() {
+  if (deferred.empty())
+    return false;
+  size_t len = std::min(reserve(), deferred.size());
+  if (len == 0)
+    return false;
+  memcpy(write_ptr(), deferred.data(), len);
+  commit(len);
+  deferred.erase(0, len);
+  return true;
+}
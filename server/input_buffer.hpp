@@ -0,0 +1,96 @@
+#ifndef INPUT_BUFFER_HPP
+#define INPUT_BUFFER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define INPUT_BUFFER_SIZE 4096
+
+/**
+ * @brief Fixed size buffer of received, not yet parsed bytes.
+ *
+ * Bytes are consumed from the front by advancing an offset, the unread
+ * rest is moved back to the start only when more room is needed. Unread
+ * data is always contiguous, so messages can be parsed in place.
+ */
+class InputBuffer {
+public:
+  InputBuffer() : storage(INPUT_BUFFER_SIZE), head(0), tail(0) {}
+
+  /**
+   * @brief Get the first unread byte.
+   */
+  const char *data() const { return storage.data() + head; }
+
+  /**
+   * @brief Get the number of unread bytes.
+   */
+  size_t size() const { return tail - head; }
+
+  /**
+   * @brief Makes the free space contiguous at the end of the buffer.
+   *
+   * @return size_t Number of bytes that can be written at write_ptr().
+   */
+  size_t reserve();
+
+  /**
+   * @brief Get the position new data is written to.
+   */
+  char *write_ptr() { return storage.data() + tail; }
+
+  /**
+   * @brief Marks bytes written at write_ptr() as received.
+   *
+   * @param bytes Number of bytes written.
+   */
+  void commit(size_t bytes) { tail += bytes; }
+
+  /**
+   * @brief Copies received data into the buffer.
+   *
+   * @param data The received data.
+   * @param len Length of the data.
+   * @return int 0 on success, -1 if the data does not fit.
+   */
+  int append(const char *data, size_t len);
+
+  /**
+   * @brief Drops parsed bytes from the front of the buffer.
+   *
+   * @param bytes Number of bytes parsed.
+   */
+  void consume(size_t bytes);
+
+  /**
+   * @brief Keeps data that does not fit until the buffer is parsed.
+   *
+   * Only for data that cannot be left in the socket, e.g. receives already
+   * completed while the connection is being handed off.
+   *
+   * @param data The received data.
+   * @param len Length of the data.
+   */
+  void defer(const char *data, size_t len) { deferred.append(data, len); }
+
+  /**
+   * @brief Moves deferred data into the buffer as far as it fits.
+   *
+   * @return bool Whether any data was moved.
+   */
+  bool refill();
+
+  /**
+   * @brief Whether deferred data is waiting for room in the buffer.
+   */
+  bool has_deferred() const { return !deferred.empty(); }
+
+private:
+  std::vector<char> storage;
+  std::string deferred; ///< Data received while the buffer was full.
+  size_t head; ///< Offset of the first unread byte.
+  size_t tail; ///< Offset one past the last received byte.
+};
+
+#endif // INPUT_BUFFER_HPP
@@ -0,0 +1,669 @@
+#include "histogram.hpp"
+#include "rng.hpp"
+#include "tick_scheduler.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * @brief Load generator playing the game with bot clients.
+ *
+ * Opens many connections to a server on the same host, spread over worker
+ * threads with an epoll loop each. Bots log in, form rooms of a few
+ * players, start games, answer every tick with TACK and sometimes a MOVE,
+ * and answer PING. Connected bots can be dropped and reconnected under
+ * the same nick to exercise reconnection.
+ *
+ * The server ticks every room on a fixed grid of the monotonic clock,
+ * see TickScheduler::phase, so the delay from the deadline of a tick to
+ * its arrival at the bot can be measured on the same host.
+ */
+
+#define LOADGEN_DEFAULT_CONNECTIONS 1000
+#define LOADGEN_DEFAULT_ROOM_SIZE 4
+#define LOADGEN_DEFAULT_TICK_MS 100
+#define LOADGEN_DEFAULT_DURATION 30
+#define LOADGEN_DEFAULT_MOVE_PCT 20
+#define LOADGEN_RETRY_MS 1000
+#define LOADGEN_EPOLL_EVENTS 256
+#define LOADGEN_SCAN_MS 50
+#define LOADGEN_PORTS_PER_SOURCE 20000
+
+/**
+ * @brief Settings of a run, from the command line.
+ */
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 8888;
+  int connections = LOADGEN_DEFAULT_CONNECTIONS;
+  int room_size = LOADGEN_DEFAULT_ROOM_SIZE;
+  int tick_ms = LOADGEN_DEFAULT_TICK_MS;
+  int board = 0;
+  int duration = LOADGEN_DEFAULT_DURATION;
+  int move_pct = LOADGEN_DEFAULT_MOVE_PCT;
+  double churn = 0;
+  int ramp = 0;
+  int threads = 1;
+  int sources = 0;
+};
+
+/**
+ * @brief Counters of a worker, read by the main thread while it runs.
+ */
+struct Counters {
+  std::atomic<uint64_t> online{0};
+  std::atomic<uint64_t> accepted{0};
+  std::atomic<uint64_t> reconnects{0};
+  std::atomic<uint64_t> drops{0};
+  std::atomic<uint64_t> failures{0};
+  std::atomic<uint64_t> ticks{0};
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> bytes_out{0};
+  /// Time the last bot got in for the first time, 0 until then.
+  std::atomic<uint64_t> all_in_ns{0};
+};
+
+enum bot_state {
+  BOT_OFFLINE,    ///< Waiting to connect.
+  BOT_CONNECTING, ///< Connect in progress.
+  BOT_HELLO,      ///< NICK sent, waiting for the first reply.
+  BOT_ONLINE,     ///< Logged in.
+};
+
+struct Bot {
+  int fd = -1;
+  int group = 0;
+  bool leader = false;
+  bool ever_in = false;   ///< Got in at least once.
+  bool skip_tick = false; ///< Next tick is not on the room's grid.
+  bot_state state = BOT_OFFLINE;
+  uint64_t connect_ns = 0; ///< Start of the connect, or when to retry.
+  std::string nick;
+  std::string in;
+  std::string out;
+};
+
+/**
+ * @brief Bots meant to play in the same room.
+ */
+struct Group {
+  int room = -1;        ///< Room id, -1 until the leader made it.
+  bool started = false; ///< The leader asked for a game to start.
+  std::vector<int> waiting; ///< Members to send to the room once made.
+};
+
+/**
+ * @brief Runs a share of the bots on its own epoll loop.
+ */
+class Worker {
+public:
+  Worker(const Options &options, int first_group, int group_count,
+         int worker_id)
+      : options(options), rng(worker_id + 1) {
+    int first = first_group * options.room_size;
+    int last = std::min(options.connections,
+                        (first_group + group_count) * options.room_size);
+    groups.resize(group_count);
+    for (int i = first; i < last; i++) {
+      Bot bot;
+      bot.group = i / options.room_size - first_group;
+      bot.leader = i % options.room_size == 0;
+      // players of an earlier run may still wait for their connections
+      bot.nick = "p" + std::to_string(getpid()) + "b" + std::to_string(i);
+      bots.push_back(std::move(bot));
+    }
+    source_base = first;
+  }
+
+  void run(const std::atomic<bool> &stop) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+      perror("epoll_create1");
+      return;
+    }
+    uint64_t started = monotonic_ns();
+    uint64_t last = started;
+    double ramp_due = 0;
+    double churn_due = 0;
+    size_t next_new = 0;
+    size_t pending_in = bots.size();
+    uint64_t next_scan = started;
+    epoll_event events[LOADGEN_EPOLL_EVENTS];
+
+    while (!stop.load(std::memory_order_relaxed)) {
+      uint64_t now = monotonic_ns();
+      double elapsed = (now - last) / 1e9;
+      last = now;
+
+      // new bots, all at once or at the ramp rate
+      if (options.ramp > 0)
+        ramp_due += elapsed * options.ramp / options.threads;
+      while (next_new < bots.size() && (options.ramp <= 0 || ramp_due >= 1)) {
+        ramp_due -= 1;
+        this->connect_bot(next_new++, now);
+      }
+
+      if (options.churn > 0 && next_new == bots.size()) {
+        churn_due += elapsed * options.churn / options.threads;
+        for (; churn_due >= 1; churn_due -= 1)
+          this->churn_one();
+      }
+
+      int n = epoll_wait(epfd, events, LOADGEN_EPOLL_EVENTS, 10);
+      for (int e = 0; e < n; e++) {
+        size_t index = events[e].data.u64;
+        Bot &bot = bots[index];
+        // dropped while handling an earlier event of this batch
+        if (bot.state == BOT_OFFLINE)
+          continue;
+        if (bot.state == BOT_CONNECTING) {
+          this->finish_connect(index);
+          continue;
+        }
+        if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+          this->drop(index, true);
+          continue;
+        }
+        if (events[e].events & EPOLLOUT)
+          this->flush(index);
+        if (events[e].events & EPOLLIN)
+          this->receive(index);
+      }
+
+      // retries and the first login of all bots need no finer timing
+      now = monotonic_ns();
+      if (now < next_scan)
+        continue;
+      next_scan = now + LOADGEN_SCAN_MS * 1000000ull;
+      for (size_t i = 0; i < next_new; i++) {
+        if (bots[i].state == BOT_OFFLINE && bots[i].connect_ns <= now)
+          this->connect_bot(i, now);
+      }
+      if (pending_in > 0) {
+        pending_in = std::count_if(bots.begin(), bots.end(),
+                                   [](const Bot &bot) { return !bot.ever_in; });
+        if (pending_in == 0)
+          counters.all_in_ns.store(now - started, std::memory_order_relaxed);
+      }
+    }
+
+    for (Bot &bot : bots) {
+      if (bot.fd >= 0)
+        close(bot.fd);
+    }
+    close(epfd);
+  }
+
+  Counters counters;
+  Histogram tick_latency;    ///< Tick deadline to arrival.
+  Histogram connect_latency; ///< Connect to the first reply.
+
+private:
+  void connect_bot(size_t index, uint64_t now) {
+    Bot &bot = bots[index];
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      this->retry_later(bot, now);
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // one source address runs out of ports long before tens of thousands
+    if (options.sources > 1) {
+      setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+      sockaddr_in source{};
+      source.sin_family = AF_INET;
+      source.sin_addr.s_addr =
+          htonl(INADDR_LOOPBACK + (source_base + index) % options.sources);
+      bind(fd, reinterpret_cast<sockaddr *>(&source), sizeof(source));
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) <
+            0 &&
+        errno != EINPROGRESS) {
+      close(fd);
+      this->retry_later(bot, now);
+      return;
+    }
+
+    bot.fd = fd;
+    bot.state = BOT_CONNECTING;
+    bot.connect_ns = now;
+    bot.in.clear();
+    bot.out.clear();
+    epoll_event ev{};
+    ev.events = EPOLLOUT;
+    ev.data.u64 = index;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+  }
+
+  void retry_later(Bot &bot, uint64_t now) {
+    counters.failures.fetch_add(1, std::memory_order_relaxed);
+    bot.state = BOT_OFFLINE;
+    bot.connect_ns = now + LOADGEN_RETRY_MS * 1000000ull;
+  }
+
+  void finish_connect(size_t index) {
+    Bot &bot = bots[index];
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(bot.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    if (error != 0) {
+      close(bot.fd);
+      bot.fd = -1;
+      this->retry_later(bot, monotonic_ns());
+      return;
+    }
+    bot.state = BOT_HELLO;
+    this->watch(index, false);
+    this->send(index, "NICK " + bot.nick + "|");
+  }
+
+  void watch(size_t index, bool writable) {
+    epoll_event ev{};
+    ev.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.u64 = index;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, bots[index].fd, &ev);
+  }
+
+  /**
+   * @brief Closes a bot's connection, it reconnects under the same nick.
+   *
+   * @param index The bot.
+   * @param by_server Whether the server closed it, retried after a delay.
+   */
+  void drop(size_t index, bool by_server) {
+    Bot &bot = bots[index];
+    if (bot.state == BOT_ONLINE)
+      counters.online.fetch_sub(1, std::memory_order_relaxed);
+    close(bot.fd);
+    bot.fd = -1;
+    bot.state = BOT_OFFLINE;
+    uint64_t now = monotonic_ns();
+    if (by_server) {
+      counters.drops.fetch_add(1, std::memory_order_relaxed);
+      bot.connect_ns = now + LOADGEN_RETRY_MS * 1000000ull;
+    } else {
+      counters.reconnects.fetch_add(1, std::memory_order_relaxed);
+      this->connect_bot(index, now);
+    }
+  }
+
+  void churn_one() {
+    // a few tries to hit an online bot, churn is best effort
+    for (int i = 0; i < 8; i++) {
+      size_t index = rng.below(bots.size());
+      if (bots[index].state == BOT_ONLINE) {
+        this->drop(index, false);
+        return;
+      }
+    }
+  }
+
+  void send(size_t index, std::string_view data) {
+    Bot &bot = bots[index];
+    bool idle = bot.out.empty();
+    bot.out += data;
+    if (idle)
+      this->flush(index);
+  }
+
+  void flush(size_t index) {
+    Bot &bot = bots[index];
+    bool was_blocked = false;
+    while (!bot.out.empty()) {
+      ssize_t sent = ::send(bot.fd, bot.out.data(), bot.out.size(),
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          was_blocked = true;
+          break;
+        }
+        if (errno == EINTR)
+          continue;
+        this->drop(index, true);
+        return;
+      }
+      counters.bytes_out.fetch_add(sent, std::memory_order_relaxed);
+      bot.out.erase(0, sent);
+    }
+    this->watch(index, was_blocked);
+  }
+
+  void receive(size_t index) {
+    char buffer[65536];
+    while (bots[index].fd >= 0) {
+      ssize_t got = recv(bots[index].fd, buffer, sizeof(buffer), 0);
+      if (got == 0) {
+        this->drop(index, true);
+        return;
+      }
+      if (got < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          this->drop(index, true);
+        break;
+      }
+      counters.bytes_in.fetch_add(got, std::memory_order_relaxed);
+      bots[index].in.append(buffer, got);
+      if (got < static_cast<ssize_t>(sizeof(buffer)))
+        break;
+    }
+    if (bots[index].fd < 0)
+      return;
+
+    uint64_t now = monotonic_ns();
+    std::string &in = bots[index].in;
+    size_t start = 0;
+    size_t end;
+    while (bots[index].fd >= 0 &&
+           (end = in.find('|', start)) != std::string::npos) {
+      this->handle(index, std::string_view(in).substr(start, end - start),
+                   now);
+      start = end + 1;
+    }
+    if (bots[index].fd >= 0)
+      bots[index].in.erase(0, start);
+  }
+
+  void enter_room(size_t index) {
+    Bot &bot = bots[index];
+    Group &group = groups[bot.group];
+    if (group.room >= 0) {
+      this->send(index, "JOIN " + std::to_string(group.room) + "|");
+    } else if (bot.leader) {
+      this->send(index, "MAKE " + std::to_string(options.tick_ms) + " " +
+                            std::to_string(options.board) + "|");
+    } else {
+      group.waiting.push_back(index);
+    }
+  }
+
+  void handle(size_t index, std::string_view msg, uint64_t now) {
+    Bot &bot = bots[index];
+    Group &group = groups[bot.group];
+    if (bot.state == BOT_HELLO) {
+      bot.state = BOT_ONLINE;
+      counters.online.fetch_add(1, std::memory_order_relaxed);
+      connect_latency.record(now - bot.connect_ns);
+      if (!bot.ever_in)
+        counters.accepted.fetch_add(1, std::memory_order_relaxed);
+      bot.ever_in = true;
+    }
+
+    std::string_view type = msg.substr(0, 4);
+    if (type == "TICK" || type == "DLTA") {
+      counters.ticks.fetch_add(1, std::memory_order_relaxed);
+      if (bot.skip_tick || group.room < 0) {
+        bot.skip_tick = false;
+      } else {
+        uint64_t interval = options.tick_ms * 1000000ull;
+        uint64_t phase = TickScheduler::phase(group.room, options.tick_ms);
+        if (now >= phase)
+          tick_latency.record((now - phase) % interval);
+      }
+      if (static_cast<int>(rng.below(100)) < options.move_pct) {
+        static const char *moves[] = {"MOVE U|", "MOVE D|", "MOVE L|",
+                                      "MOVE R|"};
+        this->send(index, moves[rng.below(4)]);
+      }
+      this->send(index, "TACK|");
+    } else if (type == "PING") {
+      this->send(index, "PONG|");
+    } else if (type == "ROOM") {
+      this->enter_room(index);
+    } else if (type == "MADE") {
+      group.room = std::stoi(std::string(msg.substr(5)));
+      group.started = false;
+      for (int member : group.waiting) {
+        if (bots[member].state == BOT_ONLINE)
+          this->send(member, "JOIN " + std::to_string(group.room) + "|");
+      }
+      group.waiting.clear();
+    } else if (type == "LOBY") {
+      // the first tick of a game is sent at once, not on the grid
+      bot.skip_tick = true;
+      int players = std::count(msg.begin(), msg.end(), ' ');
+      if (bot.leader && !group.started && players >= options.room_size) {
+        group.started = true;
+        this->send(index, "STRT|");
+      }
+    } else if (type == "WINS" || type == "DRAW") {
+      bot.skip_tick = true;
+      if (bot.leader) {
+        group.started = true;
+        this->send(index, "STRT|");
+      }
+    } else if (msg == "STRT FAIL") {
+      group.started = false;
+    } else if (type == "FULL") {
+      // the room is gone, the leader makes a new one for the group
+      if (bot.leader) {
+        group.room = -1;
+        this->enter_room(index);
+      } else {
+        group.waiting.push_back(index);
+      }
+    }
+  }
+
+  const Options &options;
+  Rng rng;
+  int epfd = -1;
+  size_t source_base = 0;
+  std::vector<Bot> bots;
+  std::vector<Group> groups;
+};
+
+static void usage(const char *name) {
+  std::cerr
+      << "usage: " << name << " [options]\n"
+      << "  -h host     server address, default 127.0.0.1\n"
+      << "  -p port     server port, default 8888\n"
+      << "  -c count    connections, default " << LOADGEN_DEFAULT_CONNECTIONS
+      << "\n"
+      << "  -r players  bots per room, default " << LOADGEN_DEFAULT_ROOM_SIZE
+      << "\n"
+      << "  -t ms       tick interval of the rooms, default "
+      << LOADGEN_DEFAULT_TICK_MS << "\n"
+      << "  -b size     board size of the rooms, default of the server\n"
+      << "  -d seconds  duration, default " << LOADGEN_DEFAULT_DURATION << "\n"
+      << "  -m percent  chance of a MOVE on a tick, default "
+      << LOADGEN_DEFAULT_MOVE_PCT << "\n"
+      << "  -C rate     reconnects per second once all bots are in\n"
+      << "  -R rate     new connections per second, default all at once\n"
+      << "  -T threads  worker threads, default 1\n"
+      << "  -S count    loopback source addresses, default one per "
+      << LOADGEN_PORTS_PER_SOURCE << " connections" << std::endl;
+}
+
+static int parse_options(int argc, char **argv, Options &options) {
+  int opt;
+  try {
+    while ((opt = getopt(argc, argv, "h:p:c:r:t:b:d:m:C:R:T:S:")) != -1) {
+      switch (opt) {
+      case 'h':
+        options.host = optarg;
+        break;
+      case 'p':
+        options.port = std::stoi(optarg);
+        break;
+      case 'c':
+        options.connections = std::stoi(optarg);
+        break;
+      case 'r':
+        options.room_size = std::stoi(optarg);
+        break;
+      case 't':
+        options.tick_ms = std::stoi(optarg);
+        break;
+      case 'b':
+        options.board = std::stoi(optarg);
+        break;
+      case 'd':
+        options.duration = std::stoi(optarg);
+        break;
+      case 'm':
+        options.move_pct = std::stoi(optarg);
+        break;
+      case 'C':
+        options.churn = std::stod(optarg);
+        break;
+      case 'R':
+        options.ramp = std::stoi(optarg);
+        break;
+      case 'T':
+        options.threads = std::stoi(optarg);
+        break;
+      case 'S':
+        options.sources = std::stoi(optarg);
+        break;
+      default:
+        return 1;
+      }
+    }
+  } catch (const std::exception &) {
+    return 1;
+  }
+  in_addr address;
+  if (optind != argc ||
+      inet_pton(AF_INET, options.host.c_str(), &address) != 1)
+    return 1;
+  if (options.connections < 1 || options.room_size < 2 ||
+      options.threads < 1 || options.duration < 1 || options.tick_ms < 1)
+    return 1;
+  if (options.sources <= 0) {
+    bool loopback = (ntohl(address.s_addr) >> 24) == 127;
+    options.sources =
+        loopback ? (options.connections + LOADGEN_PORTS_PER_SOURCE - 1) /
+                       LOADGEN_PORTS_PER_SOURCE
+                 : 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (parse_options(argc, argv, options)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    if (files.rlim_cur < static_cast<rlim_t>(options.connections) + 64)
+      std::cerr << "warning: only " << files.rlim_cur
+                << " file descriptors available" << std::endl;
+  }
+
+  // whole rooms go to one worker so a group shares its state
+  int group_count =
+      (options.connections + options.room_size - 1) / options.room_size;
+  options.threads = std::min(options.threads, group_count);
+  std::vector<std::unique_ptr<Worker>> workers;
+  int first_group = 0;
+  for (int i = 0; i < options.threads; i++) {
+    int share =
+        group_count / options.threads + (i < group_count % options.threads);
+    workers.push_back(std::make_unique<Worker>(options, first_group, share, i));
+    first_group += share;
+  }
+
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> threads;
+  for (auto &worker : workers)
+    threads.emplace_back([&worker, &stop] { worker->run(stop); });
+
+  auto sum = [&workers](std::atomic<uint64_t> Counters::*field) {
+    uint64_t total = 0;
+    for (auto &worker : workers)
+      total += (worker->counters.*field).load(std::memory_order_relaxed);
+    return total;
+  };
+
+  uint64_t last_accepted = 0, last_ticks = 0, last_in = 0, last_out = 0;
+  for (int second = 1; second <= options.duration; second++) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    uint64_t accepted = sum(&Counters::accepted);
+    uint64_t ticks = sum(&Counters::ticks);
+    uint64_t bytes_in = sum(&Counters::bytes_in);
+    uint64_t bytes_out = sum(&Counters::bytes_out);
+    std::cout << second << "s online " << sum(&Counters::online)
+              << " accepts/s " << accepted - last_accepted << " ticks/s "
+              << ticks - last_ticks << " in KiB/s "
+              << (bytes_in - last_in) / 1024 << " out KiB/s "
+              << (bytes_out - last_out) / 1024 << std::endl;
+    last_accepted = accepted;
+    last_ticks = ticks;
+    last_in = bytes_in;
+    last_out = bytes_out;
+  }
+  stop.store(true, std::memory_order_relaxed);
+  for (std::thread &thread : threads)
+    thread.join();
+
+  Histogram latency, connect;
+  uint64_t all_in_ns = 0;
+  bool all_in = true;
+  for (auto &worker : workers) {
+    latency.merge(worker->tick_latency);
+    connect.merge(worker->connect_latency);
+    uint64_t worker_in = worker->counters.all_in_ns.load();
+    all_in = all_in && worker_in > 0;
+    all_in_ns = std::max(all_in_ns, worker_in);
+  }
+  double seconds = options.duration;
+  double ramp_seconds = all_in ? all_in_ns / 1e9 : seconds;
+  uint64_t accepted = sum(&Counters::accepted);
+
+  std::cout << "connections " << options.connections << ", accepted "
+            << accepted << " in " << ramp_seconds << " s ("
+            << static_cast<uint64_t>(accepted / ramp_seconds) << "/s)"
+            << std::endl;
+  std::cout << "reconnects " << sum(&Counters::reconnects) << ", dropped "
+            << sum(&Counters::drops) << ", failed connects "
+            << sum(&Counters::failures) << std::endl;
+  std::cout << "connect to first reply ms p50 "
+            << connect.percentile(0.5) / 1e6 << " p99 "
+            << connect.percentile(0.99) / 1e6 << " max " << connect.max() / 1e6
+            << std::endl;
+  std::cout << "ticks " << sum(&Counters::ticks) << " ("
+            << static_cast<uint64_t>(sum(&Counters::ticks) / seconds)
+            << "/s), " << latency.count() << " timed" << std::endl;
+  std::cout << "tick to receive ms p50 " << latency.percentile(0.5) / 1e6
+            << " p90 " << latency.percentile(0.9) / 1e6 << " p99 "
+            << latency.percentile(0.99) / 1e6 << " p99.9 "
+            << latency.percentile(0.999) / 1e6 << " max "
+            << latency.max() / 1e6 << std::endl;
+  std::cout << "received "
+            << static_cast<uint64_t>(sum(&Counters::bytes_in) / seconds)
+            << " B/s, sent "
+            << static_cast<uint64_t>(sum(&Counters::bytes_out) / seconds)
+            << " B/s" << std::endl;
+  return 0;
+}
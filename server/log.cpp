@@ -0,0 +1,104 @@
+#include "log.hpp"
+#include "format.hpp"
+#include <chrono>
+#include <ctime>
+#include <unistd.h>
+
+static const char *level_names[LEVEL_OFF + 1] = {"debug", "info", "warn",
+                                                  "error", "off"};
+
+Logger::Logger() : min_level(LEVEL_INFO), dropped(0), running(false) {}
+
+Logger::~Logger() { this->stop(); }
+
+Logger &Logger::instance() {
+  static Logger logger;
+  return logger;
+}
+
+void Logger::start() {
+  if (running.exchange(true))
+    return;
+  thread = std::thread(&Logger::run, this);
+}
+
+void Logger::stop() {
+  if (!running.exchange(false))
+    return;
+  thread.join();
+}
+
+void Logger::push(const LogRecord &record) {
+  if (!ring.push(record))
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+int Logger::parse_level(std::string_view name, log_level &level) {
+  for (int i = LEVEL_DEBUG; i <= LEVEL_OFF; i++) {
+    if (name == level_names[i]) {
+      level = static_cast<log_level>(i);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+void Logger::write(const LogRecord &record) {
+  time_t seconds = record.time_ns / 1000000000;
+  tm local;
+  localtime_r(&seconds, &local);
+  char stamp[32];
+  size_t len = strftime(stamp, sizeof(stamp), "%H:%M:%S.", &local);
+  batch.append(stamp, len);
+  uint64_t ms = record.time_ns / 1000000 % 1000;
+  batch += '0' + ms / 100;
+  batch += '0' + ms / 10 % 10;
+  batch += '0' + ms % 10;
+  batch += ' ';
+  batch += level_names[record.level];
+  batch += ' ';
+  batch.append(record.text, record.length);
+  batch += '\n';
+}
+
+void Logger::run() {
+  LogRecord record;
+  while (true) {
+    // read before draining, so lines pushed before stop are all written
+    bool stopping = !running.load();
+    while (ring.pop(record)) {
+      this->write(record);
+    }
+    uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost > 0) {
+      append_int(batch, lost);
+      append_literal(batch, " log lines dropped\n");
+    }
+    if (!batch.empty()) {
+      // stdout is only written from here, no stream buffering needed
+      size_t done = 0;
+      while (done < batch.size()) {
+        ssize_t res =
+            ::write(STDOUT_FILENO, batch.data() + done, batch.size() - done);
+        if (res <= 0)
+          break;
+        done += res;
+      }
+      batch.clear();
+    } else if (stopping) {
+      return;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_MS));
+    }
+  }
+}
+
+LogLine::LogLine(log_level level) {
+  record.level = level;
+  record.length = 0;
+  timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  record.time_ns = now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+LogLine::~LogLine() { Logger::instance().push(record); }
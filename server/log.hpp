@@ -0,0 +1,180 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include "mpsc_queue.hpp"
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+/**
+ * @brief Severity of a log line.
+ */
+enum log_level {
+  LEVEL_DEBUG, ///< Every message and tick, boards included.
+  LEVEL_INFO,  ///< Connections, rooms and reactors coming and going.
+  LEVEL_WARN,  ///< Clients and rooms the server had to cut short.
+  LEVEL_ERROR, ///< Failures of the server itself.
+  LEVEL_OFF,   ///< Nothing is logged.
+};
+
+/// Lines below this level are compiled out, e.g. -DLOG_MIN_LEVEL=LEVEL_INFO.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LEVEL_DEBUG
+#endif
+/// Longer lines are cut.
+#define LOG_LINE_MAX 500
+/// Lines queued before new ones are dropped, a power of two.
+#define LOG_RING_SIZE 2048
+/// Sleep of the writer thread when the ring is empty.
+#define LOG_IDLE_MS 5
+
+/**
+ * @brief Tells whether lines of a level are logged.
+ *
+ * Both the compile-time and the runtime level are checked, anything
+ * guarded by it is not evaluated when the level is off.
+ */
+#define LOG_ENABLED(lvl)                                                       \
+  ((lvl) >= LOG_MIN_LEVEL && (lvl) >= Logger::instance().level())
+
+/**
+ * @brief Logs a line built from a chain of << operands.
+ *
+ * The operands are only evaluated when the level is enabled, e.g.
+ * LOG_INFO("Client connected: " << conn.get_name()).
+ */
+#define LOG(lvl, expr)                                                         \
+  do {                                                                         \
+    if (LOG_ENABLED(lvl)) {                                                    \
+      LogLine log_line(lvl);                                                   \
+      log_line << expr;                                                        \
+    }                                                                          \
+  } while (0)
+
+#define LOG_DEBUG(expr) LOG(LEVEL_DEBUG, expr)
+#define LOG_INFO(expr) LOG(LEVEL_INFO, expr)
+#define LOG_WARN(expr) LOG(LEVEL_WARN, expr)
+#define LOG_ERROR(expr) LOG(LEVEL_ERROR, expr)
+
+/**
+ * @brief One line waiting in the ring.
+ */
+struct LogRecord {
+  log_level level;
+  uint64_t time_ns; ///< CLOCK_REALTIME when it was logged.
+  uint16_t length;
+  char text[LOG_LINE_MAX];
+};
+
+/**
+ * @brief Asynchronous logger writing to stdout.
+ *
+ * Any thread formats its line on its own stack and pushes it into a
+ * lock-free ring; a background thread drains the ring and writes the
+ * lines in batches. Logging never waits for the terminal, when the ring
+ * is full the line is dropped and the drops are reported later.
+ */
+class Logger {
+public:
+  ~Logger();
+
+  /**
+   * @brief Get the process wide logger.
+   *
+   * @return Logger& The logger.
+   */
+  static Logger &instance();
+
+  /**
+   * @brief Starts the writer thread, lines logged before wait in the ring.
+   */
+  void start();
+
+  /**
+   * @brief Writes the queued lines and stops the writer thread.
+   */
+  void stop();
+
+  log_level level() const { return min_level.load(std::memory_order_relaxed); }
+  void set_level(log_level level) {
+    min_level.store(level, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Queues a line, safe to call from any thread.
+   *
+   * @param record The line.
+   */
+  void push(const LogRecord &record);
+
+  /**
+   * @brief Parses a level name.
+   *
+   * @param name One of debug, info, warn, error and off.
+   * @param level Set to the level.
+   * @return int 0 on success, 1 if the name is unknown.
+   */
+  static int parse_level(std::string_view name, log_level &level);
+
+private:
+  Logger();
+  void run();
+  void write(const LogRecord &record);
+
+  MpscQueue<LogRecord, LOG_RING_SIZE> ring;
+  std::atomic<log_level> min_level;
+  std::atomic<uint64_t> dropped;
+  std::atomic<bool> running;
+  std::thread thread;
+  std::string batch; ///< Lines formatted by the writer, then written at once.
+};
+
+/**
+ * @brief Builds a line and queues it when it goes out of scope.
+ */
+class LogLine {
+public:
+  explicit LogLine(log_level level);
+  ~LogLine();
+
+  LogLine &operator<<(std::string_view text) {
+    size_t room = LOG_LINE_MAX - record.length;
+    size_t len = text.size() < room ? text.size() : room;
+    text.copy(record.text + record.length, len);
+    record.length += len;
+    return *this;
+  }
+  LogLine &operator<<(const char *text) {
+    return *this << std::string_view(text);
+  }
+  LogLine &operator<<(const std::string &text) {
+    return *this << std::string_view(text);
+  }
+  LogLine &operator<<(char c) { return *this << std::string_view(&c, 1); }
+  LogLine &operator<<(double value) {
+    char digits[32];
+    int len = snprintf(digits, sizeof(digits), "%g", value);
+    return *this << std::string_view(digits, len);
+  }
+
+  /**
+   * @brief Appends an integer in decimal.
+   */
+  template <typename T,
+            typename = std::enable_if_t<std::is_integral<T>::value>>
+  LogLine &operator<<(T value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return *this << std::string_view(digits, result.ptr - digits);
+  }
+
+private:
+  LogRecord record;
+};
+
+#endif // LOG_HPP
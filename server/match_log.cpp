@@ -0,0 +1,166 @@
+#include "match_log.hpp"
+#include "protocol.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+static void write_all(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t res = write(fd, data.data() + written, data.size() - written);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      // a broken log must not take the match down with it
+      perror("match log write");
+      break;
+    }
+    written += res;
+  }
+}
+
+MatchLog::MatchLog() : fd(-1) {}
+
+MatchLog::~MatchLog() { this->finish(); }
+
+int MatchLog::open(const std::string &path, uint64_t seed, int size,
+                   int initial_length, const std::list<Player *> &players) {
+  this->finish();
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("match log open");
+    return 1;
+  }
+
+  buffer.clear();
+  buffer += MATCH_LOG_MAGIC;
+  put_u8(buffer, MATCH_LOG_VERSION);
+  put_u32(buffer, seed >> 32);
+  put_u32(buffer, seed & 0xffffffff);
+  put_u16(buffer, size);
+  put_u8(buffer, initial_length);
+  put_u8(buffer, players.size());
+  dirs.clear();
+  for (Player *player : players) {
+    this->put_nick(player->nickname);
+    dirs.push_back(player->dir);
+  }
+  // a match that never finishes still leaves a readable log
+  this->flush(false);
+  return 0;
+}
+
+void MatchLog::tick(const std::list<Player *> &players) {
+  put_u8(buffer, RECORD_TICK);
+  size_t count_at = buffer.size();
+  put_u8(buffer, 0);
+  uint8_t index = 0;
+  for (Player *player : players) {
+    if (dirs[index] != player->dir) {
+      dirs[index] = player->dir;
+      put_u8(buffer, index);
+      put_u8(buffer, player->dir);
+      buffer[count_at]++;
+    }
+    index++;
+  }
+  if (buffer.size() >= MATCH_LOG_FLUSH_SIZE)
+    this->flush(false);
+}
+
+void MatchLog::join(const Player &player) {
+  put_u8(buffer, RECORD_JOIN);
+  this->put_nick(player.nickname);
+  dirs.push_back(player.dir);
+}
+
+void MatchLog::leave(int index) {
+  put_u8(buffer, RECORD_LEAVE);
+  put_u8(buffer, index);
+  dirs.erase(dirs.begin() + index);
+}
+
+void MatchLog::finish() {
+  if (fd < 0)
+    return;
+  put_u8(buffer, RECORD_END);
+  this->flush(true);
+  fd = -1;
+}
+
+void MatchLog::flush(bool last) {
+  MatchLogWriter &writer = MatchLogWriter::instance();
+  if (writer.is_running()) {
+    MatchLogChunk *chunk = new MatchLogChunk{fd, std::move(buffer), last};
+    buffer.clear();
+    while (!writer.push(chunk)) {
+      if (!last) {
+        // keep buffering, the next flush tries again
+        buffer = std::move(chunk->data);
+        delete chunk;
+        return;
+      }
+      std::this_thread::yield();
+    }
+    buffer.reserve(MATCH_LOG_FLUSH_SIZE);
+    return;
+  }
+
+  write_all(fd, buffer);
+  buffer.clear();
+  if (last)
+    close(fd);
+}
+
+void MatchLog::put_nick(const std::string &nickname) {
+  // the length must fit its u8 or the rest of the log is misread
+  size_t length = std::min<size_t>(nickname.size(), MAX_NICK_LENGTH);
+  put_u8(buffer, length);
+  buffer.append(nickname, 0, length);
+}
+
+MatchLogWriter::MatchLogWriter() : running(false) {}
+
+MatchLogWriter::~MatchLogWriter() { this->stop(); }
+
+MatchLogWriter &MatchLogWriter::instance() {
+  static MatchLogWriter writer;
+  return writer;
+}
+
+void MatchLogWriter::start() {
+  if (running.exchange(true))
+    return;
+  thread = std::thread(&MatchLogWriter::run, this);
+}
+
+void MatchLogWriter::stop() {
+  if (!running.exchange(false))
+    return;
+  thread.join();
+}
+
+bool MatchLogWriter::push(MatchLogChunk *chunk) { return queue.push(chunk); }
+
+void MatchLogWriter::run() {
+  MatchLogChunk *chunk;
+  while (true) {
+    // read before draining, so chunks pushed before stop are all written
+    bool stopping = !running.load();
+    bool wrote = false;
+    while (queue.pop(chunk)) {
+      write_all(chunk->fd, chunk->data);
+      if (chunk->last)
+        close(chunk->fd);
+      delete chunk;
+      wrote = true;
+    }
+    if (stopping)
+      return;
+    if (!wrote)
+      std::this_thread::sleep_for(std::chrono::milliseconds(MATCH_LOG_IDLE_MS));
+  }
+}
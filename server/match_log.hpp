@@ -0,0 +1,178 @@
+#ifndef MATCH_LOG_HPP
+#define MATCH_LOG_HPP
+
+#include "mpsc_queue.hpp"
+#include "player.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define MATCH_LOG_MAGIC "SNKM"
+#define MATCH_LOG_VERSION 1
+#define MATCH_LOG_FLUSH_SIZE 4096
+/// Chunks waiting for the writer thread, a power of two.
+#define MATCH_LOG_QUEUE_SIZE 1024
+/// Sleep of the writer thread when no chunk waits.
+#define MATCH_LOG_IDLE_MS 5
+
+/**
+ * @brief Records of a match log.
+ *
+ * A log starts with a header: the magic, u8 version, u64 seed, u16 board
+ * size, u8 initial snake length, u8 number of players and per player u8
+ * nick length and nick, in room order. Records follow, each a u8 kind and
+ * its arguments. All integers are big endian.
+ */
+enum match_record {
+  RECORD_TICK = 1, ///< u8 count, per changed direction u8 player and u8 dir.
+  RECORD_JOIN,     ///< u8 nick length and nick, added as the last player.
+  RECORD_LEAVE,    ///< u8 player index.
+  RECORD_END,      ///< The match is over.
+};
+
+/**
+ * @brief Append-only binary log of a match.
+ *
+ * The match follows from the seed of the room and the directions the
+ * snakes had on every tick, so only the directions that changed since the
+ * previous tick are written, together with players entering and leaving
+ * the room. Records are buffered and written to the file in batches, by
+ * the MatchLogWriter thread when it runs.
+ */
+class MatchLog {
+public:
+  MatchLog();
+  ~MatchLog();
+
+  MatchLog(const MatchLog &) = delete;
+  MatchLog &operator=(const MatchLog &) = delete;
+
+  /**
+   * @brief Creates the log file and writes the header.
+   *
+   * @param path The file, replaced if it exists.
+   * @param seed Seed the room was hatched with.
+   * @param size Board size of the room.
+   * @param initial_length Initial snake length of the room.
+   * @param players Players of the room after hatching.
+   * @return int 0 on success, 1 if the file could not be created.
+   */
+  int open(const std::string &path, uint64_t seed, int size,
+           int initial_length, const std::list<Player *> &players);
+
+  bool is_open() const { return fd >= 0; }
+
+  /**
+   * @brief Records the directions the snakes advance in on this tick.
+   *
+   * @param players Players of the room.
+   */
+  void tick(const std::list<Player *> &players);
+
+  /**
+   * @brief Records a player entering the room.
+   *
+   * @param player The player, added as the last one.
+   */
+  void join(const Player &player);
+
+  /**
+   * @brief Records a player leaving the room.
+   *
+   * @param index Position of the player in the room.
+   */
+  void leave(int index);
+
+  /**
+   * @brief Ends the match, writes the rest of the log and closes it.
+   *
+   * Does nothing if no log is open.
+   */
+  void finish();
+
+private:
+  /**
+   * @brief Hands the buffered records to the writer thread, or writes them
+   * when it does not run.
+   *
+   * While the writer's queue is full the records stay buffered, only the
+   * last chunk waits for a free cell.
+   *
+   * @param last Whether the file is closed after the chunk.
+   */
+  void flush(bool last);
+
+  /**
+   * @brief Appends a u8 nick length and the nick, cut to MAX_NICK_LENGTH.
+   *
+   * @param nickname The nick.
+   */
+  void put_nick(const std::string &nickname);
+
+  int fd;                          ///< Log file, -1 if not recording.
+  std::string buffer;              ///< Records not written yet.
+  std::vector<Direction> dirs;     ///< Last recorded direction per player.
+};
+
+/**
+ * @brief Records of a match log on their way to the disk.
+ */
+struct MatchLogChunk {
+  int fd;           ///< Log file.
+  std::string data; ///< Records to append.
+  bool last;        ///< Whether to close the file afterwards.
+};
+
+/**
+ * @brief Background thread writing the match logs of all reactors.
+ *
+ * Reactors push full buffers into a lock-free queue instead of writing
+ * them, so a slow disk never stalls a tick. The chunks of one log come
+ * from a single reactor and are written in order.
+ */
+class MatchLogWriter {
+public:
+  ~MatchLogWriter();
+
+  /**
+   * @brief Get the process wide writer.
+   *
+   * @return MatchLogWriter& The writer.
+   */
+  static MatchLogWriter &instance();
+
+  /**
+   * @brief Starts the writer thread, logs are written in place before.
+   */
+  void start();
+
+  /**
+   * @brief Writes the queued chunks and stops the writer thread.
+   */
+  void stop();
+
+  bool is_running() const { return running.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Queues a chunk, safe to call from any thread.
+   *
+   * @param chunk The chunk, owned by the writer once queued.
+   * @return true If the chunk was queued.
+   * @return false If the queue is full.
+   */
+  bool push(MatchLogChunk *chunk);
+
+private:
+  MatchLogWriter();
+  void run();
+
+  MpscQueue<MatchLogChunk *, MATCH_LOG_QUEUE_SIZE> queue;
+  std::atomic<bool> running;
+  std::thread thread;
+};
+
+#endif // MATCH_LOG_HPP
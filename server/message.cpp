@@ -0,0 +1,65 @@
+#include "message.hpp"
+
+#define MAX_POOLED_MESSAGES 4096
+#define MAX_POOLED_MESSAGE_CAPACITY (64 * 1024)
+
+MessageRef::MessageRef(Message *msg) : msg(msg) {
+  if (msg)
+    msg->refs++;
+}
+
+MessageRef::MessageRef(const MessageRef &other) : msg(other.msg) {
+  if (msg)
+    msg->refs++;
+}
+
+MessageRef::MessageRef(MessageRef &&other) noexcept : msg(other.msg) {
+  other.msg = nullptr;
+}
+
+MessageRef &MessageRef::operator=(MessageRef other) noexcept {
+  std::swap(msg, other.msg);
+  return *this;
+}
+
+MessageRef::~MessageRef() {
+  if (!msg || --msg->refs > 0)
+    return;
+  if (msg->pool)
+    msg->pool->release(msg);
+  else
+    delete msg;
+}
+
+MessageRef MessageRef::unpooled(std::string data) {
+  Message *msg = new Message{std::move(data), 0, nullptr};
+  return MessageRef(msg);
+}
+
+MessagePool::~MessagePool() {
+  for (Message *msg : free) {
+    delete msg;
+  }
+}
+
+MessageRef MessagePool::acquire() {
+  Message *msg;
+  if (free.empty()) {
+    msg = new Message{std::string(), 0, this};
+  } else {
+    msg = free.back();
+    free.pop_back();
+  }
+  return MessageRef(msg);
+}
+
+void MessagePool::release(Message *msg) {
+  // drop oversized buffers and anything beyond what a busy tick needs
+  if (free.size() >= MAX_POOLED_MESSAGES ||
+      msg->data.capacity() > MAX_POOLED_MESSAGE_CAPACITY) {
+    delete msg;
+    return;
+  }
+  msg->data.clear();
+  free.push_back(msg);
+}
@@ -0,0 +1,93 @@
+#ifndef MESSAGE_HPP
+#define MESSAGE_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MessagePool;
+
+/**
+ * @brief A reference counted, encoded server message.
+ *
+ * A message is written once and then only read, the same message can sit
+ * in the output queues of many connections. The reference count is not
+ * atomic, messages never leave the reactor owning their pool.
+ */
+class Message {
+public:
+  std::string data;  ///< Encoded message including the '|' delimiter.
+  int refs;          ///< Number of MessageRef objects pointing here.
+  MessagePool *pool; ///< Pool the message returns to, nullptr to delete.
+};
+
+/**
+ * @brief Owning handle to a Message.
+ */
+class MessageRef {
+public:
+  MessageRef() : msg(nullptr) {}
+  explicit MessageRef(Message *msg);
+  MessageRef(const MessageRef &other);
+  MessageRef(MessageRef &&other) noexcept;
+  MessageRef &operator=(MessageRef other) noexcept;
+  ~MessageRef();
+
+  /**
+   * @brief Get the message buffer for writing.
+   *
+   * Only valid while the message has not been queued for sending.
+   *
+   * @return std::string& The message buffer.
+   */
+  std::string &buffer() { return msg->data; }
+
+  const char *data() const { return msg->data.data(); }
+  size_t size() const { return msg->data.size(); }
+  explicit operator bool() const { return msg != nullptr; }
+
+  /**
+   * @brief Creates a message that is deleted instead of pooled once released.
+   *
+   * Used for data that has to leave the reactor, e.g. with a handed off
+   * connection.
+   *
+   * @param data The encoded message.
+   * @return MessageRef The new message.
+   */
+  static MessageRef unpooled(std::string data);
+
+private:
+  Message *msg;
+};
+
+/**
+ * @brief Free list of messages reused to avoid allocating on every send.
+ *
+ * Released messages keep the capacity of their buffer, so in steady state
+ * encoding a message does not allocate.
+ */
+class MessagePool {
+public:
+  ~MessagePool();
+
+  /**
+   * @brief Get an empty message to encode into.
+   *
+   * @return MessageRef The message, with a single reference.
+   */
+  MessageRef acquire();
+
+  /**
+   * @brief Returns a message without references to the pool.
+   *
+   * @param msg The released message.
+   */
+  void release(Message *msg);
+
+private:
+  std::vector<Message *> free;
+};
+
+#endif // MESSAGE_HPP
@@ -0,0 +1,272 @@
+#include "metrics.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define ADMIN_BACKLOG 16
+#define ADMIN_TIMEOUT_S 1
+/// Prometheus buckets per power of two, out of HISTOGRAM_SUB.
+#define EXPORT_BUCKETS_PER_OCTAVE 4
+
+static const char *eviction_names[EVICTION_COUNT] = {
+    "connection_timeout", "player_timeout", "send_backlog", "input_flood"};
+
+static void append_double(std::string &out, double value) {
+  char digits[32];
+  int len = snprintf(digits, sizeof(digits), "%.9g", value);
+  out.append(digits, len);
+}
+
+static void append_family(std::string &out, const char *name,
+                          const char *type, const char *help) {
+  append_literal(out, "# HELP ");
+  out += name;
+  out += ' ';
+  out += help;
+  append_literal(out, "\n# TYPE ");
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+static void append_sample(std::string &out, const char *name, size_t shard,
+                          uint64_t value, const char *label = nullptr,
+                          std::string_view label_value = {}) {
+  out += name;
+  append_literal(out, "{reactor=\"");
+  append_int(out, shard);
+  out += '"';
+  if (label) {
+    out += ',';
+    out += label;
+    append_literal(out, "=\"");
+    out += label_value;
+    out += '"';
+  }
+  append_literal(out, "} ");
+  append_int(out, value);
+  out += '\n';
+}
+
+/**
+ * @brief Writes a histogram family.
+ *
+ * The fine buckets are merged into EXPORT_BUCKETS_PER_OCTAVE per power of
+ * two, from the one holding min_value up to the highest value seen, which
+ * keeps the bucket set stable between scrapes.
+ */
+static void append_histogram(std::string &out, const char *name,
+                             const char *help,
+                             const std::vector<const Metrics *> &shards,
+                             Histogram Metrics::*field, uint64_t min_value,
+                             double scale, bool integral) {
+  const size_t step = HISTOGRAM_SUB / EXPORT_BUCKETS_PER_OCTAVE;
+  append_family(out, name, "histogram", help);
+  std::string bucket = std::string(name) + "_bucket";
+  for (size_t shard = 0; shard < shards.size(); shard++) {
+    const Histogram &histogram = shards[shard]->*field;
+    size_t first =
+        std::max(step, Histogram::bucket(min_value) / step * step);
+    size_t end = (Histogram::bucket(histogram.max()) / step + 1) * step;
+    uint64_t below = 0;
+    size_t i = 0;
+    for (size_t bound = first; bound <= end; bound += step) {
+      for (; i < bound; i++)
+        below += histogram.at(i);
+      // the bucket holds every value below the fine bucket at bound
+      uint64_t edge = Histogram::lower_bound(bound);
+      out += bucket;
+      append_literal(out, "{reactor=\"");
+      append_int(out, shard);
+      append_literal(out, "\",le=\"");
+      if (integral)
+        append_int(out, edge - 1);
+      else
+        append_double(out, edge * scale);
+      append_literal(out, "\"} ");
+      append_int(out, below);
+      out += '\n';
+    }
+    out += bucket;
+    append_literal(out, "{reactor=\"");
+    append_int(out, shard);
+    append_literal(out, "\",le=\"+Inf\"} ");
+    append_int(out, histogram.count());
+    out += '\n';
+
+    out += name;
+    append_literal(out, "_sum{reactor=\"");
+    append_int(out, shard);
+    append_literal(out, "\"} ");
+    append_double(out, histogram.sum() * scale);
+    out += '\n';
+    out += name;
+    append_literal(out, "_count{reactor=\"");
+    append_int(out, shard);
+    append_literal(out, "\"} ");
+    append_int(out, histogram.count());
+    out += '\n';
+  }
+}
+
+static void append_metric(std::string &out, const char *name,
+                          const char *type, const char *help,
+                          const std::vector<const Metrics *> &shards,
+                          Metric Metrics::*field) {
+  append_family(out, name, type, help);
+  for (size_t shard = 0; shard < shards.size(); shard++)
+    append_sample(out, name, shard, (shards[shard]->*field).get());
+}
+
+std::string render_metrics(const std::vector<const Metrics *> &shards) {
+  std::string out;
+  append_family(out, "snake_requests_total", "counter",
+                "Client messages parsed, by type.");
+  for (size_t shard = 0; shard < shards.size(); shard++) {
+    for (int type = INVALID + 1; type < MSG_TYPE_COUNT; type++)
+      append_sample(out, "snake_requests_total", shard,
+                    shards[shard]->requests[type].get(), "type",
+                    msg_type_name(static_cast<msg_type>(type)));
+  }
+  append_metric(out, "snake_malformed_requests_total", "counter",
+                "Client messages that failed to parse.", shards,
+                &Metrics::malformed);
+  append_metric(out, "snake_received_bytes_total", "counter",
+                "Bytes received from clients.", shards,
+                &Metrics::bytes_received);
+  append_metric(out, "snake_sent_bytes_total", "counter",
+                "Bytes sent to clients.", shards, &Metrics::bytes_sent);
+
+  append_family(out, "snake_evictions_total", "counter",
+                "Connections and players removed by the server, by reason.");
+  for (size_t shard = 0; shard < shards.size(); shard++) {
+    for (int reason = 0; reason < EVICTION_COUNT; reason++)
+      append_sample(out, "snake_evictions_total", shard,
+                    shards[shard]->evictions[reason].get(), "reason",
+                    eviction_names[reason]);
+  }
+
+  append_metric(out, "snake_tick_overruns_total", "counter",
+                "Room ticks that ran over an interval late.", shards,
+                &Metrics::tick_overruns);
+  append_metric(out, "snake_skipped_ticks_total", "counter",
+                "Late room ticks dropped instead of caught up.", shards,
+                &Metrics::skipped_ticks);
+  append_metric(out, "snake_connections", "gauge", "Open connections.",
+                shards, &Metrics::connections);
+  append_metric(out, "snake_players", "gauge",
+                "Players, including those waiting to reconnect.", shards,
+                &Metrics::players);
+  append_metric(out, "snake_rooms", "gauge", "Open rooms.", shards,
+                &Metrics::rooms);
+  append_metric(out, "snake_games", "gauge", "Rooms with a running game.",
+                shards, &Metrics::games);
+  append_metric(out, "snake_send_backlog_bytes", "gauge",
+                "Bytes queued to all connections.", shards,
+                &Metrics::send_backlog);
+  append_metric(out, "snake_send_backlog_max_bytes", "gauge",
+                "Longest queue of a single connection.", shards,
+                &Metrics::send_backlog_max);
+
+  append_histogram(out, "snake_tick_duration_seconds",
+                   "Time to tick a room and queue its messages, all rooms "
+                   "of a reactor in one histogram.",
+                   shards, &Metrics::tick_duration, 1000, 1e-9, false);
+  append_histogram(out, "snake_event_batch_size",
+                   "Events handled per wakeup of a reactor.", shards,
+                   &Metrics::event_batch, 1, 1, true);
+  return out;
+}
+
+AdminServer::AdminServer(std::vector<const Metrics *> shards)
+    : shards(std::move(shards)), socket_fd(-1) {}
+
+AdminServer::~AdminServer() {
+  if (socket_fd < 0)
+    return;
+  // wakes the blocked accept
+  shutdown(socket_fd, SHUT_RDWR);
+  if (thread.joinable())
+    thread.join();
+  close(socket_fd);
+}
+
+int AdminServer::start(int port) {
+  socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd < 0) {
+    perror("admin socket");
+    return 1;
+  }
+  int opt = 1;
+  setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  // metrics are for the operator only, never exposed beyond the host
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(socket_fd, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) ||
+      listen(socket_fd, ADMIN_BACKLOG)) {
+    perror("admin socket");
+    close(socket_fd);
+    socket_fd = -1;
+    return 1;
+  }
+
+  thread = std::thread(&AdminServer::serve, this);
+  LOG_INFO("Metrics on: 127.0.0.1:" << port);
+  return 0;
+}
+
+void AdminServer::serve() {
+  while (true) {
+    int client = accept4(socket_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (client < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      return;
+    }
+    timeval timeout = {ADMIN_TIMEOUT_S, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // every request gets the metrics, the request head is only drained so
+    // closing does not reset the connection
+    char request[1024];
+    if (recv(client, request, sizeof(request), 0) <= 0) {
+      close(client);
+      continue;
+    }
+
+    std::string body = render_metrics(shards);
+    std::string response;
+    append_literal(response, "HTTP/1.0 200 OK\r\n"
+                             "Content-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: ");
+    append_int(response, body.size());
+    append_literal(response, "\r\nConnection: close\r\n\r\n");
+    response += body;
+
+    size_t sent = 0;
+    while (sent < response.size()) {
+      ssize_t res = send(client, response.data() + sent,
+                         response.size() - sent, MSG_NOSIGNAL);
+      if (res <= 0) {
+        if (res < 0 && errno == EINTR)
+          continue;
+        break;
+      }
+      sent += res;
+    }
+    close(client);
+  }
+}
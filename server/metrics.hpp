@@ -0,0 +1,98 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "histogram.hpp"
+#include "protocol.hpp"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A value written by one thread and read by any.
+ *
+ * Counters only grow, gauges are set to the current value.
+ */
+struct Metric {
+  std::atomic<uint64_t> value{0};
+
+  void add(uint64_t by = 1) {
+    value.store(value.load(std::memory_order_relaxed) + by,
+                std::memory_order_relaxed);
+  }
+  void set(uint64_t to) { value.store(to, std::memory_order_relaxed); }
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/**
+ * @brief Reasons a connection or player is removed by the server.
+ */
+enum eviction {
+  EVICT_CONNECTION_TIMEOUT, ///< Connection silent for too long.
+  EVICT_PLAYER_TIMEOUT,     ///< Player not reconnected in time.
+  EVICT_SEND_BACKLOG,       ///< Client not reading its messages.
+  EVICT_INPUT_FLOOD,        ///< Client filling its room's input queue.
+  EVICTION_COUNT,           ///< Number of reasons.
+};
+
+/**
+ * @brief Counters and histograms of one reactor.
+ *
+ * Only the reactor's thread writes them, the admin thread reads them at
+ * any time. Gauges are refreshed by the reactor's timer.
+ */
+struct Metrics {
+  Metric requests[MSG_TYPE_COUNT]; ///< Messages parsed per type.
+  Metric malformed;                ///< Messages that failed to parse.
+  Metric bytes_received;
+  Metric bytes_sent;
+  Metric evictions[EVICTION_COUNT];
+  Metric tick_overruns;  ///< Room ticks run late by over an interval.
+  Metric skipped_ticks;  ///< Late room ticks dropped.
+  Metric connections;    ///< Gauge of open connections.
+  Metric players;        ///< Gauge of players, disconnected ones included.
+  Metric rooms;          ///< Gauge of open rooms.
+  Metric games;          ///< Gauge of rooms with a running game.
+  Metric send_backlog;   ///< Gauge of bytes queued to all connections.
+  Metric send_backlog_max; ///< Gauge of the longest queue of a connection.
+  Histogram tick_duration; ///< Nanoseconds of each room tick, all rooms.
+  Histogram event_batch;   ///< Events handled per epoll or io_uring wait.
+};
+
+/**
+ * @brief Writes the metrics of all reactors in the Prometheus text format.
+ *
+ * @param shards Metrics of each reactor, labelled with its index.
+ * @return std::string The exposition.
+ */
+std::string render_metrics(const std::vector<const Metrics *> &shards);
+
+/**
+ * @brief Serves the metrics over HTTP on a local port.
+ *
+ * Runs on its own thread and answers every request with the metrics, so
+ * scraping never touches the reactors beyond reading their counters.
+ */
+class AdminServer {
+public:
+  AdminServer(std::vector<const Metrics *> shards);
+  ~AdminServer();
+
+  /**
+   * @brief Starts listening on 127.0.0.1.
+   *
+   * @param port The port.
+   * @return int 0 on success, 1 if the socket could not be set up.
+   */
+  int start(int port);
+
+private:
+  void serve();
+
+  std::vector<const Metrics *> shards;
+  int socket_fd;
+  std::thread thread;
+};
+
+#endif // METRICS_HPP
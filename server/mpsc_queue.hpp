@@ -0,0 +1,94 @@
+#ifndef MPSC_QUEUE_HPP
+#define MPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Bounded lock-free queue for many producers and one consumer.
+ *
+ * Every cell carries a sequence number telling whether it is free for the
+ * producer claiming that position or filled for the consumer, so producers
+ * only contend on a single compare-and-swap of the tail and the consumer
+ * never writes anything the producers spin on besides the cell it frees.
+ *
+ * @tparam T Copyable element type.
+ * @tparam Capacity Number of cells, a power of two.
+ */
+template <typename T, size_t Capacity> class MpscQueue {
+  static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                "capacity must be a power of two");
+
+public:
+  MpscQueue() : tail(0), head(0) {
+    for (size_t i = 0; i < Capacity; i++) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscQueue(const MpscQueue &) = delete;
+  MpscQueue &operator=(const MpscQueue &) = delete;
+
+  /**
+   * @brief Appends an element, safe to call from any thread.
+   *
+   * @param value The element.
+   * @return true If the element was queued.
+   * @return false If the queue is full.
+   */
+  bool push(const T &value) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell &cell = cells[pos & (Capacity - 1)];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence - pos);
+      if (diff == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+
+    Cell &cell = cells[pos & (Capacity - 1)];
+    cell.value = value;
+    cell.sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Takes the oldest element, only the consumer thread may call it.
+   *
+   * @param value Set to the element.
+   * @return true If an element was taken.
+   * @return false If the queue is empty or the oldest element is still
+   * being written.
+   */
+  bool pop(T &value) {
+    Cell &cell = cells[head & (Capacity - 1)];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence != head + 1)
+      return false;
+
+    value = cell.value;
+    cell.sequence.store(head + Capacity, std::memory_order_release);
+    head++;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence; ///< Position the cell is ready for.
+    T value;
+  };
+
+  alignas(64) std::atomic<size_t> tail; ///< Next position to claim.
+  alignas(64) size_t head;              ///< Next position to take.
+  Cell cells[Capacity];
+};
+
+#endif // MPSC_QUEUE_HPP
@@ -1,12 +1,15 @@
 #ifndef PLAYER_HPP
 #define PLAYER_HPP
 
-#include <string>
-#include <deque>
-#include <chrono>
+#include "timing_wheel.hpp"
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
 
-#define GRID_SIZE 10
 #define INITIAL_SNAKE_LENGTH 3
 
 enum Direction {
@@ -17,18 +20,48 @@ enum Direction {
   DIRECTION_COUNT,
 };
 
-inline std::string dir_to_string(Direction dir) {
+inline char dir_to_char(Direction dir) {
   switch (dir) {
   case UP:
-    return "U";
+    return 'U';
   case DOWN:
-    return "D";
+    return 'D';
   case LEFT:
-    return "L";
+    return 'L';
   case RIGHT:
-    return "R";
+    return 'R';
   default:
-    return "?";
+    return '?';
+  }
+}
+
+inline Direction char_to_dir(char dir) {
+  switch (dir) {
+  case 'U':
+    return UP;
+  case 'D':
+    return DOWN;
+  case 'L':
+    return LEFT;
+  case 'R':
+    return RIGHT;
+  default:
+    return DIRECTION_COUNT;
+  }
+}
+
+inline Direction opposite(Direction dir) {
+  switch (dir) {
+  case UP:
+    return DOWN;
+  case DOWN:
+    return UP;
+  case LEFT:
+    return RIGHT;
+  case RIGHT:
+    return LEFT;
+  default:
+    return DIRECTION_COUNT;
   }
 }
 
@@ -47,6 +80,150 @@ struct Position {
   }
 };
 
+/**
+ * @brief Tile coordinates packed into 16 bits each, boards are at most
+ * 1024 tiles wide.
+ */
+struct PackedPosition {
+  uint16_t x;
+  uint16_t y;
+};
+
+/**
+ * @brief Snake body as a ring buffer of packed positions, head first.
+ *
+ * Next to every part but the head the body keeps the direction from the
+ * previous part as a char (U, D, L, R), in a second ring laid out like the
+ * parts. A move writes the one new link and dropping the tail needs no
+ * work, so the encoded body is always at hand as at most two spans.
+ *
+ * The storage is borrowed from the arena of the room the snake plays in,
+ * pushing and popping never allocates. A detached body is empty and holds
+ * no storage.
+ */
+class SnakeBody {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Position;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Position *;
+    using reference = Position;
+
+    iterator(const SnakeBody *body, uint32_t index)
+        : body(body), index(index) {}
+    Position operator*() const { return (*body)[index]; }
+    iterator &operator++() {
+      index++;
+      return *this;
+    }
+    bool operator==(const iterator &other) const {
+      return index == other.index;
+    }
+    bool operator!=(const iterator &other) const {
+      return index != other.index;
+    }
+
+  private:
+    const SnakeBody *body;
+    uint32_t index;
+  };
+
+  SnakeBody()
+      : parts(nullptr), links(nullptr), capacity(0), head(0), count(0) {}
+
+  /**
+   * @brief Empties the body and gives it new storage.
+   *
+   * @param storage Room for capacity parts, must outlive the use.
+   * @param link_storage Room for capacity links, must outlive the use.
+   * @param capacity Longest possible body.
+   */
+  void attach(PackedPosition *storage, char *link_storage, uint32_t capacity) {
+    parts = storage;
+    links = link_storage;
+    this->capacity = capacity;
+    head = count = 0;
+  }
+
+  /**
+   * @brief Empties the body and releases its storage.
+   */
+  void detach() { attach(nullptr, nullptr, 0); }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  void clear() { count = 0; }
+
+  Position operator[](size_t i) const {
+    size_t at = slot(i);
+    return {parts[at].x, parts[at].y};
+  }
+
+  /**
+   * @brief Get the direction from part i - 1 to part i.
+   *
+   * @param i Index of the part, at least 1.
+   * @return char U, D, L or R.
+   */
+  char link(size_t i) const { return links[slot(i)]; }
+
+  /**
+   * @brief Appends the links of all parts after the head, tail last.
+   *
+   * @param out Buffer to append to.
+   */
+  void append_links(std::string &out) const {
+    if (count < 2)
+      return;
+    size_t first = slot(1);
+    size_t length = count - 1;
+    size_t run = std::min<size_t>(length, capacity - first);
+    out.append(links + first, run);
+    out.append(links, length - run);
+  }
+  Position front() const { return (*this)[0]; }
+  Position back() const { return (*this)[count - 1]; }
+
+  void push_front(Position pos) {
+    // never happens with storage for every tile of the board
+    if (count == capacity)
+      count--;
+    head = head == 0 ? capacity - 1 : head - 1;
+    parts[head] = {static_cast<uint16_t>(pos.x), static_cast<uint16_t>(pos.y)};
+    count++;
+  }
+
+  /**
+   * @brief Moves the head to a neighbouring tile.
+   *
+   * @param pos The new head.
+   * @param dir Direction of the move.
+   */
+  void push_front(Position pos, Direction dir) {
+    push_front(pos);
+    // the old head is reached from the new one by going back
+    links[slot(1)] = dir_to_char(opposite(dir));
+  }
+  void pop_back() { count--; }
+
+  iterator begin() const { return iterator(this, 0); }
+  iterator end() const { return iterator(this, count); }
+
+private:
+  size_t slot(size_t i) const {
+    size_t at = head + i;
+    return at >= capacity ? at - capacity : at;
+  }
+
+  PackedPosition *parts;
+  char *links; ///< Direction from the previous part, unused for the head.
+  uint32_t capacity;
+  uint32_t head;  ///< Index of the head in parts.
+  uint32_t count; ///< Number of parts.
+};
+
 class Player {
 public:
   std::string nickname;
@@ -54,14 +231,20 @@ public:
   Direction last_move_dir;
   bool alive;
   bool updated;
+  /// TACK received since the last drain of the room's inputs, set from any
+  /// thread so an acknowledgement never waits for a queue cell.
+  std::atomic<bool> acked;
+  bool moved;       ///< Head advanced in the last tick.
+  bool tail_popped; ///< Tail was removed in the last tick.
   int apples;
   int length;
-  std::deque<Position> body;
-  std::chrono::steady_clock::time_point last_active;
+  SnakeBody body;
+  TimerNode<Player> timeout; ///< Removes the player when inactive.
   
   Player(const std::string &nickname)
-      : nickname(nickname), last_move_dir(DIRECTION_COUNT),
-        length(INITIAL_SNAKE_LENGTH) {}
+      : nickname(nickname), dir(UP), last_move_dir(DIRECTION_COUNT),
+        alive(false), updated(false), acked(false), moved(false), tail_popped(false),
+        apples(0), length(INITIAL_SNAKE_LENGTH), timeout(this) {}
 };
 
 #endif // PLAYER_HPP
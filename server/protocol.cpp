@@ -1,15 +1,255 @@
 #include "protocol.hpp"
+#include <charconv>
 #include <string>
-#include <unordered_map>
 
-std::unordered_map<std::string, msg_type> msg_type_map = {
-    {"PONG", PONG},  {"NICK", NICK},    {"LEAV", LEAVE},      {"MOVE", MOVE},
-    {"STRT", START}, {"QUIT", QUIT},    {"LIST", LIST_ROOMS}, {"JOIN", JOIN},
-    {"TACK", TACK},  {"ZZZZ", WAITING}, {"SSSS", OK}};
+static constexpr std::string_view server_msg_names[SERVER_MSG_COUNT] = {
+    "",     "ROOM", "LOBY", "TICK", "DLTA", "PING",    "WAIT",
+    "WINS", "DRAW", "FULL", "LEFT", "MOVD", "STRT OK", "STRT FAIL",
+    "ROMS", "MADE", "BORD", "WTCH"};
 
-msg_type get_msg_type(std::string key_token) {
-  auto it = msg_type_map.find(key_token);
-  if (it == msg_type_map.end())
+static constexpr std::string_view msg_type_names[MSG_TYPE_COUNT] = {
+    "",     "PONG", "NICK", "LEAV", "MOVE", "STRT", "QUIT", "LIST",
+    "JOIN", "TACK", "ZZZZ", "SSSS", "SYNC", "MAKE", "WTCH"};
+
+std::string_view msg_type_name(msg_type type) {
+  if (static_cast<unsigned>(type) >= MSG_TYPE_COUNT)
+    return "";
+  return msg_type_names[type];
+}
+
+msg_type get_msg_type(std::string_view key_token) {
+  if (key_token.size() != 4)
+    return INVALID;
+  switch (pack_opcode(key_token.data())) {
+  case pack_opcode("PONG"):
+    return PONG;
+  case pack_opcode("NICK"):
+    return NICK;
+  case pack_opcode("LEAV"):
+    return LEAVE;
+  case pack_opcode("MOVE"):
+    return MOVE;
+  case pack_opcode("STRT"):
+    return START;
+  case pack_opcode("QUIT"):
+    return QUIT;
+  case pack_opcode("LIST"):
+    return LIST_ROOMS;
+  case pack_opcode("JOIN"):
+    return JOIN;
+  case pack_opcode("TACK"):
+    return TACK;
+  case pack_opcode("ZZZZ"):
+    return WAITING;
+  case pack_opcode("SSSS"):
+    return OK;
+  case pack_opcode("SYNC"):
+    return SYNC;
+  case pack_opcode("MAKE"):
+    return MAKE;
+  case pack_opcode("WTCH"):
+    return WATCH;
+  default:
     return INVALID;
-  return it->second;
-}
\ No newline at end of file
+  }
+}
+
+/**
+ * @brief Splits a message on spaces, empty tokens are kept.
+ *
+ * @return int Number of tokens, -1 if there are more than max.
+ */
+static int split(std::string_view msg, std::string_view *tokens, int max) {
+  int count = 0;
+  while (true) {
+    if (count == max)
+      return -1;
+    size_t space = msg.find(' ');
+    tokens[count++] = msg.substr(0, space);
+    if (space == std::string_view::npos)
+      return count;
+    msg.remove_prefix(space + 1);
+  }
+}
+
+static int parse_direction(char c, Direction &dir) {
+  switch (c) {
+  case 'U':
+    dir = UP;
+    break;
+  case 'D':
+    dir = DOWN;
+    break;
+  case 'L':
+    dir = LEFT;
+    break;
+  case 'R':
+    dir = RIGHT;
+    break;
+  default:
+    return 1;
+  }
+  return 0;
+}
+
+static int parse_int(std::string_view token, int &value) {
+  const char *end = token.data() + token.size();
+  auto res = std::from_chars(token.data(), end, value);
+  return res.ec != std::errc() || res.ptr != end || value < 0;
+}
+
+int parse_request(std::string_view msg, Request &req) {
+  std::string_view tokens[MAX_TOKENS];
+  int count = split(msg, tokens, MAX_TOKENS);
+  if (count < 0)
+    return 1;
+  req.type = get_msg_type(tokens[0]);
+
+  switch (req.type) {
+  case OK:
+  case WAITING:
+  case PONG:
+  case TACK:
+    break;
+  case NICK:
+    if (count < 2 || tokens[1].size() > MAX_NICK_LENGTH)
+      return 1;
+    req.nick.assign(tokens[1]);
+    req.delta = false;
+    req.binary = false;
+    // optional capabilities follow the nick
+    for (int i = 2; i < count; i++) {
+      if (tokens[i] == "DLTA")
+        req.delta = true;
+      else if (tokens[i] == "BINR")
+        req.binary = true;
+      else
+        return 1;
+    }
+    break;
+  case JOIN:
+    if (count != 2)
+      return 1;
+    return parse_int(tokens[1], req.room_id);
+  case MOVE:
+    if (count != 2 || tokens[1].size() != 1)
+      return 1;
+    return parse_direction(tokens[1][0], req.dir);
+  case LIST_ROOMS:
+    req.page = -1;
+    if (count == 1)
+      break;
+    if (count != 2)
+      return 1;
+    return parse_int(tokens[1], req.page);
+  case MAKE:
+    // zero keeps the default of an argument
+    req.tick_ms = 0;
+    req.grid_size = 0;
+    req.length = 0;
+    if (count > 4)
+      return 1;
+    if (count > 1 && parse_int(tokens[1], req.tick_ms))
+      return 1;
+    if (count > 2 && parse_int(tokens[2], req.grid_size))
+      return 1;
+    if (count > 3 && parse_int(tokens[3], req.length))
+      return 1;
+    break;
+  case WATCH:
+    req.every = 0;
+    if (count != 2 && count != 3)
+      return 1;
+    if (count == 3 && parse_int(tokens[2], req.every))
+      return 1;
+    return parse_int(tokens[1], req.room_id);
+  case LEAVE:
+  case START:
+  case QUIT:
+  case SYNC:
+    if (count != 1)
+      return 1;
+    break;
+  case INVALID:
+  case MSG_TYPE_COUNT:
+    return 1;
+  }
+  return 0;
+}
+
+int parse_binary_request(const char *data, size_t len, Request &req) {
+  if (len < 1)
+    return 1;
+  req.type = static_cast<msg_type>(static_cast<uint8_t>(data[0]));
+
+  switch (req.type) {
+  case OK:
+  case WAITING:
+  case PONG:
+  case TACK:
+  case LEAVE:
+  case START:
+  case QUIT:
+  case SYNC:
+    return len != 1;
+  case MAKE:
+    req.tick_ms = len >= 3 ? get_u16(data + 1) : 0;
+    req.grid_size = len >= 5 ? get_u16(data + 3) : 0;
+    req.length = len >= 6 ? static_cast<uint8_t>(data[5]) : 0;
+    return len != 1 && len != 3 && len != 5 && len != 6;
+  case LIST_ROOMS:
+    if (len == 1) {
+      req.page = -1;
+      return 0;
+    }
+    if (len != 3)
+      return 1;
+    req.page = get_u16(data + 1);
+    return 0;
+  case JOIN:
+    if (len != 3)
+      return 1;
+    req.room_id = get_u16(data + 1);
+    return 0;
+  case WATCH:
+    if (len != 3 && len != 4)
+      return 1;
+    req.room_id = get_u16(data + 1);
+    req.every = len == 4 ? static_cast<uint8_t>(data[3]) : 0;
+    return 0;
+  case MOVE:
+    if (len != 2 || static_cast<uint8_t>(data[1]) >= DIRECTION_COUNT)
+      return 1;
+    req.dir = static_cast<Direction>(data[1]);
+    return 0;
+  default:
+    // NICK is only accepted as text
+    return 1;
+  }
+}
+
+size_t begin_message(std::string &out, server_msg type, bool binary) {
+  size_t start = out.size();
+  if (binary) {
+    put_u16(out, 0);
+    put_u8(out, type);
+  } else {
+    out += server_msg_names[type];
+  }
+  return start;
+}
+
+int end_message(std::string &out, size_t start, bool binary) {
+  if (binary) {
+    size_t len = out.size() - start - 2;
+    if (len > MAX_FRAME_LENGTH) {
+      out.resize(start);
+      return 1;
+    }
+    out[start] = static_cast<char>(len >> 8);
+    out[start + 1] = static_cast<char>(len & 0xff);
+  } else {
+    out += '|';
+  }
+  return 0;
+}
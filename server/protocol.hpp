@@ -1,9 +1,21 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include "player.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
+
+#define MAX_TOKENS 8
+#define MAX_FRAME_LENGTH 0xffff ///< Binary frames carry a u16 length.
+#define MAX_NICK_LENGTH 64 ///< Binary frames carry the nick length in a u8.
+
 /**
  * @brief Message types used in the communication protocol.
+ *
+ * The values double as opcodes of binary client frames, new types are
+ * appended.
  */
 enum msg_type {
   INVALID,    ///< Invalid or unrecognized message.
@@ -18,8 +30,83 @@ enum msg_type {
   TACK,       ///< Client acknowledge tick (Tick Ack).
   WAITING,    ///< Waiting state notification.
   OK,         ///< Generic OK response.
+  SYNC,       ///< Request a keyframe on the next tick.
+  MAKE,       ///< Create a room and join it.
+  WATCH,      ///< Watch a room as a spectator.
+  MSG_TYPE_COUNT, ///< Upper bound of the opcodes.
+};
+
+/**
+ * @brief Messages sent by the server.
+ *
+ * The values are the opcodes of binary server frames.
+ */
+enum server_msg {
+  MSG_ROOM = 1,      ///< Room sizes.
+  MSG_LOBY,          ///< Players in the room.
+  MSG_TICK,          ///< Full game state.
+  MSG_DLTA,          ///< Game state changes.
+  MSG_PING,          ///< Liveliness check.
+  MSG_WAIT,          ///< Waiting for lagging players.
+  MSG_WINS,          ///< Game won.
+  MSG_DRAW,          ///< Game ended in a draw.
+  MSG_FULL,          ///< Room is full.
+  MSG_LEFT,          ///< Room left.
+  MSG_MOVD,          ///< Move accepted.
+  MSG_STRT_OK,       ///< Game started.
+  MSG_STRT_FAIL,     ///< Game could not be started.
+  MSG_ROMS,          ///< A page of the room list.
+  MSG_MADE,          ///< Room created.
+  MSG_BORD,          ///< Board size of the joined room.
+  MSG_WTCH,          ///< Watching a room.
+  SERVER_MSG_COUNT,  ///< Upper bound of the opcodes.
+};
+
+/**
+ * @brief Encodings of the game state sent on every tick.
+ */
+enum tick_format {
+  TICK_FULL,         ///< Full state (TICK), sent to legacy clients.
+  TICK_KEYFRAME,     ///< Full state with sequence number (KEYF).
+  TICK_DELTA,        ///< Changes since the previous tick (DLTA).
+  TICK_BIN_KEYFRAME, ///< Binary full state.
+  TICK_BIN_DELTA,    ///< Binary changes since the previous tick.
+  TICK_FORMAT_COUNT, ///< Number of formats.
 };
 
+/**
+ * @brief A decoded client message.
+ */
+struct Request {
+  msg_type type = INVALID;
+  std::string nick; ///< NICK: Requested nickname.
+  bool delta;       ///< NICK: Client accepts KEYF/DLTA ticks.
+  bool binary;      ///< NICK: Switch to binary frames after this message.
+  int room_id;      ///< JOIN, WTCH: Requested room.
+  int page;         ///< LIST: Requested page, -1 for the pinned rooms only.
+  int tick_ms;      ///< MAKE: Tick interval of the room, 0 for the default.
+  int grid_size;    ///< MAKE: Board size of the room, 0 for the default.
+  int length;       ///< MAKE: Initial snake length, 0 for the default.
+  int every;        ///< WTCH: Send every nth tick, 0 for every tick.
+  Direction dir;    ///< MOVE: Requested direction.
+};
+
+/**
+ * @brief Packs a four letter opcode into an integer.
+ *
+ * Lets opcodes be compared with a single integer compare and used as case
+ * labels.
+ *
+ * @param s At least four characters.
+ * @return uint32_t The packed opcode.
+ */
+constexpr uint32_t pack_opcode(const char *s) {
+  return static_cast<uint32_t>(static_cast<uint8_t>(s[0])) |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[1])) << 8 |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[2])) << 16 |
+         static_cast<uint32_t>(static_cast<uint8_t>(s[3])) << 24;
+}
+
 /**
  * @brief Helper function to parse a message token string to obtain the message
  * type.
@@ -27,5 +114,84 @@ enum msg_type {
  * @param key_token The string command.
  * @return msg_type The corresponding enum value.
  */
-msg_type get_msg_type(std::string key_token);
-#endif
\ No newline at end of file
+msg_type get_msg_type(std::string_view key_token);
+
+/**
+ * @brief Get the keyword of a message type.
+ *
+ * @param type The message type.
+ * @return std::string_view The keyword, empty for INVALID and unknown types.
+ */
+std::string_view msg_type_name(msg_type type);
+
+/**
+ * @brief Parses a text message without the '|' delimiter.
+ *
+ * Does not allocate, except for the nickname of NICK.
+ *
+ * @param msg The message.
+ * @param req The decoded message.
+ * @return int 0 on success, 1 if the message is malformed.
+ */
+int parse_request(std::string_view msg, Request &req);
+
+/**
+ * @brief Parses the body of a binary frame.
+ *
+ * A frame is a big endian u16 length followed by that many bytes, the
+ * opcode (msg_type) and its arguments:
+ * - MOVE: u8 direction
+ * - JOIN: u16 room id
+ * - LIST: optional u16 page
+ * - MAKE: optional u16 tick interval, u16 board size and u8 initial length,
+ *   each only after the ones before it
+ * - WTCH: u16 room id, optional u8 tick divisor
+ *
+ * @param data Start of the frame body, after the length.
+ * @param len Length of the frame body.
+ * @param req The decoded message.
+ * @return int 0 on success, 1 if the frame is malformed.
+ */
+int parse_binary_request(const char *data, size_t len, Request &req);
+
+/**
+ * @brief Starts a server message.
+ *
+ * @param out Buffer to append to.
+ * @param type The message.
+ * @param binary Whether to encode a binary frame.
+ * @return size_t Offset of the message, passed to end_message.
+ */
+size_t begin_message(std::string &out, server_msg type, bool binary);
+
+/**
+ * @brief Finishes a server message, adding the delimiter or frame length.
+ *
+ * A binary frame longer than MAX_FRAME_LENGTH is removed from the buffer
+ * instead, its length would not fit the header.
+ *
+ * @param out Buffer holding the message.
+ * @param start Offset returned by begin_message.
+ * @param binary Whether the message is a binary frame.
+ * @return int 0 on success, 1 if the frame was too long.
+ */
+int end_message(std::string &out, size_t start, bool binary);
+
+inline void put_u8(std::string &out, uint8_t value) {
+  out += static_cast<char>(value);
+}
+
+inline void put_u16(std::string &out, uint16_t value) {
+  out += static_cast<char>(value >> 8);
+  out += static_cast<char>(value & 0xff);
+}
+
+inline void put_u32(std::string &out, uint32_t value) {
+  put_u16(out, value >> 16);
+  put_u16(out, value & 0xffff);
+}
+
+inline uint16_t get_u16(const char *data) {
+  return static_cast<uint8_t>(data[0]) << 8 | static_cast<uint8_t>(data[1]);
+}
+#endif
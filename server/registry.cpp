@@ -0,0 +1,57 @@
+#include "registry.hpp"
+
+Player *Registry::add(std::unique_ptr<Player> player) {
+  Player *raw = player.get();
+  Session &session = by_nick[raw->nickname];
+  session.player = std::move(player);
+  session.conn = nullptr;
+  session.room_id = -1;
+  by_player[raw] = &session;
+  return raw;
+}
+
+std::unique_ptr<Player> Registry::take(Player *player) {
+  auto it = by_nick.find(player->nickname);
+  std::unique_ptr<Player> taken = std::move(it->second.player);
+  by_nick.erase(it);
+  by_player.erase(player);
+  return taken;
+}
+
+Player *Registry::find(const std::string &nick) const {
+  auto it = by_nick.find(nick);
+  if (it == by_nick.end())
+    return nullptr;
+  return it->second.player.get();
+}
+
+Registry::Session *Registry::session(Player *player) const {
+  auto it = by_player.find(player);
+  if (it == by_player.end())
+    return nullptr;
+  return it->second;
+}
+
+Connection *Registry::connection_of(Player *player) const {
+  Session *s = session(player);
+  return s ? s->conn : nullptr;
+}
+
+void Registry::bind(Player *player, Connection *conn) {
+  session(player)->conn = conn;
+}
+
+void Registry::unbind(Player *player, Connection *conn) {
+  Session *s = session(player);
+  if (s && s->conn == conn)
+    s->conn = nullptr;
+}
+
+int Registry::room_of(Player *player) const {
+  Session *s = session(player);
+  return s ? s->room_id : -1;
+}
+
+void Registry::set_room(Player *player, int room_id) {
+  session(player)->room_id = room_id;
+}
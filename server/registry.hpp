@@ -0,0 +1,104 @@
+#ifndef REGISTRY_HPP
+#define REGISTRY_HPP
+
+#include "player.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class Connection;
+
+/**
+ * @brief Players of a reactor with their connection and room.
+ *
+ * Owns the players and indexes them by nickname, every lookup is O(1).
+ * The indexes are updated together, so a player removed from the registry
+ * leaves no stale connection or room behind.
+ */
+class Registry {
+public:
+  /**
+   * @brief Adds a player, its nickname must not be registered yet.
+   *
+   * @param player The player.
+   * @return Player* The added player.
+   */
+  Player *add(std::unique_ptr<Player> player);
+
+  /**
+   * @brief Removes a player together with its connection and room.
+   *
+   * @param player A registered player.
+   * @return std::unique_ptr<Player> The player.
+   */
+  std::unique_ptr<Player> take(Player *player);
+
+  /**
+   * @brief Finds a player by nickname.
+   *
+   * @param nick The nickname.
+   * @return Player* The player, nullptr if not registered.
+   */
+  Player *find(const std::string &nick) const;
+
+  /**
+   * @brief Finds the connection a player is currently bound to.
+   *
+   * @param player The player.
+   * @return Connection* The player's connection, nullptr if disconnected or
+   * not registered.
+   */
+  Connection *connection_of(Player *player) const;
+
+  /**
+   * @brief Binds a player to a connection, replacing the previous one.
+   *
+   * @param player A registered player.
+   * @param conn The connection.
+   */
+  void bind(Player *player, Connection *conn);
+
+  /**
+   * @brief Unbinds a player if it is still bound to the given connection.
+   *
+   * @param player The player.
+   * @param conn The connection going away.
+   */
+  void unbind(Player *player, Connection *conn);
+
+  /**
+   * @brief Get the room a player is in.
+   *
+   * @param player The player.
+   * @return int The room id, -1 if in no room or not registered.
+   */
+  int room_of(Player *player) const;
+
+  /**
+   * @brief Records the room a player is in.
+   *
+   * @param player A registered player.
+   * @param room_id The room id, -1 for no room.
+   */
+  void set_room(Player *player, int room_id);
+
+  /**
+   * @brief Get the number of registered players.
+   */
+  size_t size() const { return by_player.size(); }
+
+private:
+  struct Session {
+    std::unique_ptr<Player> player;
+    Connection *conn; ///< Bound connection, nullptr if disconnected.
+    int room_id;      ///< Room the player is in, -1 if none.
+  };
+
+  Session *session(Player *player) const;
+
+  std::unordered_map<std::string, Session> by_nick;
+  std::unordered_map<Player *, Session *> by_player;
+};
+
+#endif // REGISTRY_HPP
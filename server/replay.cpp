@@ -0,0 +1,169 @@
+#include "game.hpp"
+#include "match_log.hpp"
+#include "protocol.hpp"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Reads a match log and plays the match again.
+ *
+ * The room is hatched with the logged seed and every tick applies the
+ * logged directions before calling Game::slither, as fast as possible.
+ * Prints the final state, with -v the state after every tick.
+ */
+
+/**
+ * @brief Cursor over the bytes of a log.
+ */
+struct LogReader {
+  const std::string &data;
+  size_t at;
+
+  bool has(size_t count) const { return data.size() - at >= count; }
+  uint8_t u8() { return static_cast<uint8_t>(data[at++]); }
+  uint16_t u16() {
+    uint16_t value = get_u16(data.data() + at);
+    at += 2;
+    return value;
+  }
+  uint32_t u32() {
+    uint32_t high = u16();
+    return high << 16 | u16();
+  }
+  int nick(std::string &out) {
+    if (!has(1))
+      return 1;
+    uint8_t len = u8();
+    if (!has(len))
+      return 1;
+    out.assign(data, at, len);
+    at += len;
+    return 0;
+  }
+};
+
+static int replay(const std::string &data, bool verbose) {
+  LogReader in{data, 0};
+  size_t magic_len = strlen(MATCH_LOG_MAGIC);
+  if (!in.has(magic_len + 1 + 8 + 2 + 1 + 1) ||
+      data.compare(0, magic_len, MATCH_LOG_MAGIC) != 0) {
+    std::cerr << "not a match log" << std::endl;
+    return 1;
+  }
+  in.at = magic_len;
+  if (in.u8() != MATCH_LOG_VERSION) {
+    std::cerr << "unsupported match log version" << std::endl;
+    return 1;
+  }
+  uint64_t seed = static_cast<uint64_t>(in.u32()) << 32;
+  seed |= in.u32();
+  int size = in.u16();
+  int initial_length = in.u8();
+  int count = in.u8();
+  if (size < MIN_GRID_SIZE || size > MAX_GRID_SIZE) {
+    std::cerr << "bad board size " << size << std::endl;
+    return 1;
+  }
+
+  Game game;
+  game.configure(size);
+  game.initial_length = initial_length;
+  std::vector<std::unique_ptr<Player>> players;
+  for (int i = 0; i < count; i++) {
+    std::string nick;
+    if (in.nick(nick)) {
+      std::cerr << "truncated header" << std::endl;
+      return 1;
+    }
+    players.push_back(std::make_unique<Player>(nick));
+    game.add_player(players.back().get());
+  }
+  if (game.hatch(seed)) {
+    std::cerr << "match cannot start" << std::endl;
+    return 1;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  uint64_t ticks = 0;
+  bool ended = false;
+  while (!ended && in.has(1)) {
+    uint8_t kind = in.u8();
+    switch (kind) {
+    case RECORD_TICK: {
+      if (!in.has(1))
+        return 1;
+      int changes = in.u8();
+      if (!in.has(2 * changes))
+        return 1;
+      for (int i = 0; i < changes; i++) {
+        size_t index = in.u8();
+        uint8_t dir = in.u8();
+        if (index >= game.players.size() || dir >= DIRECTION_COUNT) {
+          std::cerr << "bad tick record" << std::endl;
+          return 1;
+        }
+        (*std::next(game.players.begin(), index))->dir =
+            static_cast<Direction>(dir);
+      }
+      game.slither();
+      ticks++;
+      if (verbose)
+        std::cout << game.tick_seq << " " << game.full_state() << std::endl;
+    } break;
+    case RECORD_JOIN: {
+      std::string nick;
+      if (in.nick(nick))
+        return 1;
+      players.push_back(std::make_unique<Player>(nick));
+      game.add_player(players.back().get());
+    } break;
+    case RECORD_LEAVE: {
+      if (!in.has(1))
+        return 1;
+      size_t index = in.u8();
+      if (index >= game.players.size())
+        return 1;
+      game.remove_player(*std::next(game.players.begin(), index));
+    } break;
+    case RECORD_END:
+      ended = true;
+      break;
+    default:
+      std::cerr << "unknown record " << int(kind) << std::endl;
+      return 1;
+    }
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - started)
+                       .count();
+
+  std::cout << "final " << game.full_state() << std::endl;
+  std::cout << ticks << " ticks in " << seconds * 1000 << " ms";
+  if (seconds > 0)
+    std::cout << " (" << static_cast<uint64_t>(ticks / seconds)
+              << " ticks/s)";
+  std::cout << (ended ? "" : ", log ends early") << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  bool verbose = argc > 2 && std::string(argv[1]) == "-v";
+  if (argc < 2 || (argc > 2 && !verbose)) {
+    std::cerr << "usage: " << argv[0] << " [-v] <match log>" << std::endl;
+    return 1;
+  }
+  std::ifstream file(argv[argc - 1], std::ios::binary);
+  if (!file) {
+    perror(argv[argc - 1]);
+    return 1;
+  }
+  std::string data((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  return replay(data, verbose);
+}
@@ -0,0 +1,65 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <cstdint>
+
+/**
+ * @brief xoshiro256** pseudo random generator.
+ *
+ * Small and fast, and the whole sequence follows from one 64-bit seed, so
+ * a room seeded for a match can be simulated again with the same seed.
+ */
+class Rng {
+public:
+  explicit Rng(uint64_t seed = 0) { this->seed(seed); }
+
+  /**
+   * @brief Restarts the sequence.
+   *
+   * The state is expanded from the seed with splitmix64, which never
+   * yields the all zero state.
+   *
+   * @param seed The seed.
+   */
+  void seed(uint64_t seed) {
+    for (uint64_t &word : s) {
+      seed += 0x9e3779b97f4a7c15ull;
+      uint64_t z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      word = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t next() {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  /**
+   * @brief Get a number below a bound.
+   *
+   * Scales the upper 32 bits instead of taking a remainder, the bias is
+   * negligible for the board sizes used.
+   *
+   * @param bound The bound, not 0.
+   * @return uint32_t A number in [0, bound).
+   */
+  uint32_t below(uint32_t bound) {
+    return static_cast<uint32_t>(((next() >> 32) * bound) >> 32);
+  }
+
+private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t s[4];
+};
+
+#endif // RNG_HPP
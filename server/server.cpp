@@ -1,4 +1,7 @@
 #include "server.hpp"
+#include "format.hpp"
+#include "log.hpp"
+#include "match_log.hpp"
 #include "protocol.hpp"
 #include <algorithm>
 #include <arpa/inet.h>
@@ -8,36 +11,66 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <cerrno>
 #include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <ostream>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <thread>
 #include <type_traits>
 #include <unistd.h>
 #include <vector>
 
-#define NUMBER_OF_ROOMS 4
 #define MAX_EVENTS 10
 #define PLAYER_REMOVAL_TIMEOUT 60
 #define CONNECTION_TIMEOUT 10
-#define GLOBAL_TIMER_CHECK 1
-#define GAME_SPEED 1
 #define PING_INTERVAL 2
 #define MAX_PLAYERS_IN_ROOM 4
-
-Server::Server(int port, const std::string &ip_address)
-    : port(port), ip_address(ip_address),
-      last_ping(std::chrono::steady_clock::now()) {
+#define SEND_BACKLOG_DEGRADE (16 * 1024)
+#define SEND_BACKLOG_LIMIT (256 * 1024)
+#define KEYFRAME_INTERVAL 16
+#define TIMING_WHEEL_SLOTS 64
+#define ROOM_POOL_SIZE 16
+#define ROOM_PAGE_SIZE 32
+
+Server::Server(int port, const std::string &ip_address, Cluster &cluster,
+               int shard_id)
+    : cluster(cluster), shard_id(shard_id), port(port),
+      ip_address(ip_address), board_tiles(0),
+      connection_timeouts(TIMING_WHEEL_SLOTS),
+      player_timeouts(TIMING_WHEEL_SLOTS), armed_tick_deadline(0),
+      started(std::chrono::steady_clock::now()),
+      last_ping(std::chrono::steady_clock::now()),
+      seeds(std::random_device{}() ^ static_cast<uint64_t>(shard_id) << 32),
+      use_uring(false), next_generation(0), starved_since(0),
+      returned_at_submit{0, 0} {
+  rooms.resize(cluster.room_sizes.size());
+  for (int i = 0; i < ROOM_POOL_SIZE; i++) {
+    room_pool.push_back(std::make_unique<Game>());
+  }
   for (int i = 0; i < NUMBER_OF_ROOMS; i++) {
-    rooms.push_back(Game());
+    if (cluster.room_owner(i) == shard_id)
+      this->create_room(i);
   }
+
+  // created here rather than in setup, other reactors may hand off
+  // connections before this one starts serving
+  handoff_fd = eventfd(0, EFD_NONBLOCK);
+  if (handoff_fd == -1)
+    throw std::runtime_error("eventfd");
 }
 
 int Server::serve() {
+  if (use_uring)
+    return this->serve_uring();
+
   try {
     this->setup();
 
@@ -46,6 +79,8 @@ int Server::serve() {
 
     while (true) {
       int event_count = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+      if (event_count > 0)
+        metrics.event_batch.record(event_count);
       for (int i = 0; i < event_count; i++) {
         int fd = events[i].data.fd;
         if (fd == server_socket) {
@@ -54,27 +89,284 @@ int Server::serve() {
           this->handle_timer();
         } else if (fd == this->game_timer_fd) {
           this->handle_game_tick();
+        } else if (fd == this->handoff_fd) {
+          this->handle_handoffs();
         } else if (connections.count(fd)) {
-          this->handle_socket_read(fd);
+          if (events[i].events & EPOLLOUT)
+            this->handle_socket_write(fd);
+          if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP) &&
+              connections.count(fd))
+            this->handle_socket_read(fd);
         }
+        this->close_pending();
       }
     }
   } catch (const std::exception &e) {
-    std::cerr << "Server error: " << e.what() << std::endl;
+    LOG_ERROR("Server error: " << e.what());
     return 1;
   }
   return 0;
 }
 
-void Server::broadcast_game(Game &game, std::string msg) {
+void Server::broadcast_game(Game &game, const MessageRef &text,
+                            const MessageRef &binary, bool droppable) {
+  for (Player *player : game.players) {
+    Connection *conn = connection_of(player);
+    if (conn) {
+      send_message(*conn, conn->binary ? binary : text, droppable);
+    }
+  }
+  for (Connection *conn : game.spectators) {
+    send_message(*conn, conn->binary ? binary : text, droppable);
+  }
+}
+
+void Server::broadcast_game(Game &game, server_msg type) {
+  broadcast_game(game, simple_message(type, false), simple_message(type, true));
+}
+
+const MessageRef &Server::simple_message(server_msg type, bool binary) {
+  MessageRef &msg = simple_messages[binary][type];
+  if (!msg) {
+    msg = message_pool.acquire();
+    std::string &buff = msg.buffer();
+    end_message(buff, begin_message(buff, type, binary), binary);
+  }
+  return msg;
+}
+
+MessageRef Server::encode_lobby(Game &game, bool binary) {
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_LOBY, binary);
+  if (binary)
+    put_u8(buff, game.players.size());
+  for (Player *player : game.players) {
+    if (binary) {
+      put_u8(buff, player->nickname.size());
+      buff += player->nickname;
+    } else {
+      append_field(buff, player->nickname);
+    }
+  }
+  end_message(buff, start, binary);
+  return msg;
+}
+
+MessageRef Server::encode_wait(Game &game, bool binary) {
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_WAIT, binary);
+  size_t count_at = buff.size();
+  if (binary)
+    put_u8(buff, 0);
+  int id = 0;
+  for (Player *player : game.players) {
+    if (!player->updated) {
+      if (binary) {
+        put_u8(buff, id);
+        buff[count_at]++;
+      } else {
+        append_field(buff, player->nickname);
+      }
+    }
+    id++;
+  }
+  end_message(buff, start, binary);
+  return msg;
+}
+
+MessageRef Server::encode_wins(Game &game, Player *winner, bool binary) {
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_WINS, binary);
+  if (binary)
+    put_u8(buff, game.player_id(winner));
+  else
+    append_field(buff, winner->nickname);
+  end_message(buff, start, binary);
+  return msg;
+}
+
+MessageRef Server::encode_tick(Game &game, tick_format format) {
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start;
+  switch (format) {
+  case TICK_BIN_KEYFRAME:
+    start = begin_message(buff, MSG_TICK, true);
+    put_u32(buff, game.tick_seq);
+    if (game.full_state_binary(buff))
+      buff.resize(start);
+    else
+      end_message(buff, start, true);
+    return msg;
+  case TICK_BIN_DELTA:
+    start = begin_message(buff, MSG_DLTA, true);
+    put_u32(buff, game.tick_seq);
+    game.delta_state_binary(buff);
+    end_message(buff, start, true);
+    return msg;
+  case TICK_KEYFRAME:
+    append_literal(buff, "KEYF ");
+    append_int(buff, game.tick_seq);
+    buff += ' ';
+    game.full_state(buff);
+    break;
+  case TICK_DELTA:
+    append_literal(buff, "DLTA ");
+    append_int(buff, game.tick_seq);
+    buff += ' ';
+    game.delta_state(buff);
+    break;
+  default:
+    append_literal(buff, "TICK ");
+    game.full_state(buff);
+    break;
+  }
+  buff += '|';
+  return msg;
+}
+
+tick_format Server::tick_format_for(Connection &conn, Game &game) {
+  if (conn.watching >= 0) {
+    if (conn.binary)
+      return TICK_BIN_KEYFRAME;
+    return conn.delta_ticks ? TICK_KEYFRAME : TICK_FULL;
+  }
+  if (!conn.delta_ticks)
+    return conn.binary ? TICK_BIN_KEYFRAME : TICK_FULL;
+  if (conn.need_keyframe || game.tick_seq % KEYFRAME_INTERVAL == 0) {
+    conn.need_keyframe = false;
+    return conn.binary ? TICK_BIN_KEYFRAME : TICK_KEYFRAME;
+  }
+  return conn.binary ? TICK_BIN_DELTA : TICK_DELTA;
+}
+
+void Server::broadcast_tick(Game &game, bool last) {
+  MessageRef encoded[TICK_FORMAT_COUNT];
   for (Player *player : game.players) {
-    auto it = std::find_if(
-        this->connections.begin(), this->connections.end(),
-        [player](const auto &pair) { return pair.second->player == player; });
-    if (it != this->connections.end()) {
-      send(it->second->socket, msg.c_str(), msg.size(), 0);
+    Connection *conn = connection_of(player);
+    if (!conn)
+      continue;
+    tick_format format = tick_format_for(*conn, game);
+    if (!encoded[format])
+      encoded[format] = encode_tick(game, format);
+    send_message(*conn, encoded[format]);
+  }
+
+  // the spectators share the players' frames, a slow one only loses ticks
+  for (Connection *conn : game.spectators) {
+    if (!last && game.tick_seq % conn->watch_every != 0)
+      continue;
+    tick_format format = tick_format_for(*conn, game);
+    if (!encoded[format])
+      encoded[format] = encode_tick(game, format);
+    send_message(*conn, encoded[format], true);
+  }
+}
+
+Connection *Server::connection_of(Player *player) {
+  return registry.connection_of(player);
+}
+
+void Server::bind_player(Connection &conn, Player *player) {
+  conn.player = player;
+  registry.bind(player, &conn);
+}
+
+void Server::send_message(Connection &conn, server_msg type,
+                          bool droppable) {
+  send_message(conn, simple_message(type, conn.binary), droppable);
+}
+
+void Server::send_message(Connection &conn, const MessageRef &msg,
+                          bool droppable) {
+  if (conn.closing)
+    return;
+  // a frame that did not fit its length field is left empty
+  if (msg.size() == 0) {
+    LOG_WARN("Message too long for a binary frame: " << conn.get_name());
+    schedule_close(conn);
+    return;
+  }
+  if (droppable && conn.backlog() > SEND_BACKLOG_DEGRADE)
+    return;
+
+  conn.queue(msg);
+  if (conn.backlog() > SEND_BACKLOG_LIMIT) {
+    LOG_WARN("Send backlog limit exceeded: " << conn.get_name());
+    metrics.evictions[EVICT_SEND_BACKLOG].add();
+    schedule_close(conn);
+    return;
+  }
+
+  // socket already known to be full, wait for EPOLLOUT or the pending send
+  if (conn.want_write || conn.send_in_flight)
+    return;
+  if (flush_connection(conn))
+    schedule_close(conn);
+}
+
+int Server::flush_connection(Connection &conn) {
+  if (use_uring) {
+    this->uring_send(conn);
+    return 0;
+  }
+
+  // gathered write of the queued messages, they are not copied together
+  iovec iov[SEND_IOV_MAX];
+  msghdr hdr = {};
+  hdr.msg_iov = iov;
+  while (conn.backlog()) {
+    hdr.msg_iovlen = conn.gather(iov, SEND_IOV_MAX);
+    ssize_t sent = sendmsg(conn.socket, &hdr, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return -1;
     }
+    metrics.bytes_sent.add(sent);
+    conn.consume(sent);
+  }
+
+  // only watch for writability while there is something left to write
+  bool want_write = conn.backlog() > 0;
+  if (want_write != conn.want_write) {
+    epoll_event ev = {};
+    ev.events = want_write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    ev.data.fd = conn.socket;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.socket, &ev)) {
+      perror("epoll_ctl");
+      return -1;
+    }
+    conn.want_write = want_write;
+  }
+  return 0;
+}
+
+void Server::handle_socket_write(int sock_fd) {
+  auto it = connections.find(sock_fd);
+  if (it == connections.end())
+    return;
+  if (flush_connection(*it->second))
+    schedule_close(*it->second);
+}
+
+void Server::schedule_close(Connection &conn) {
+  if (conn.closing)
+    return;
+  conn.closing = true;
+  pending_close.push_back(conn.socket);
+}
+
+void Server::close_pending() {
+  for (int fd : pending_close) {
+    this->close_connection(fd);
   }
+  pending_close.clear();
 }
 
 void Server::handle_game_tick() {
@@ -84,58 +376,112 @@ void Server::handle_game_tick() {
     perror("gametimerfd read");
     return;
   }
+  // the timer is one-shot, it fires once per armed deadline
+  armed_tick_deadline = 0;
+  this->run_game_tick();
+}
 
-  for (Game &game : rooms) {
-    if (game.active) {
-      std::vector<Player *> inactive;
-      for (auto player : game.players)
-        if (!player->updated)
-          inactive.push_back(player);
+void Server::run_game_tick() {
+  uint64_t now = monotonic_ns();
+  int ticks, skipped;
+  Game *game;
+  while ((game = tick_scheduler.next_due(now, ticks, skipped))) {
+    int ran = 0;
+    while (ran < ticks && game->active) {
+      uint64_t started = monotonic_ns();
+      bool advanced = this->tick_room(*game, ran > 0);
+      metrics.tick_duration.record(monotonic_ns() - started);
+      if (!advanced)
+        break;
+      ran++;
+    }
+    // a room waiting for TACKs cannot make up for the ticks it missed
+    if (ran < ticks && game->active)
+      skipped += ticks - std::max(ran, 1);
+
+    int missed = ticks - 1 + skipped;
+    if (missed) {
+      LOG_WARN("Room " << game->id << " overran by " << missed << " ticks ("
+                       << skipped << " skipped)");
+      metrics.tick_overruns.add();
+      metrics.skipped_ticks.add(skipped);
+    }
+  }
+  this->arm_game_timer();
+}
 
-      if (inactive.size()) {
-        std::string msg = "WAIT";
-        for (auto player : inactive) {
-          msg += " " + player->nickname;
-        }
-        msg += "|";
-
-        // Only send WAIT to players who have updated
-        for (Player *player : game.players) {
-          if (player->updated) {
-            auto it =
-                std::find_if(this->connections.begin(), this->connections.end(),
-                             [player](const auto &pair) {
-                               return pair.second->player == player;
-                             });
-            if (it != this->connections.end()) {
-              send(it->second->socket, msg.c_str(), msg.size(), 0);
-            }
-          }
-        }
-        continue;
-      };
-
-      std::cout << game.full_state() << std::endl;
-      std::cout << game.current_move() << std::endl;
-      bool game_continues = game.slither();
-      if (game_continues) {
-        broadcast_game(game, "TICK " + game.full_state() + "|");
-        std::cout << "-----" << std::endl;
-        game.print();
-        std::cout << "-----" << std::endl;
-      } else {
-        broadcast_game(game, "TICK " + game.full_state() + "|");
-        auto it = std::find_if(game.players.begin(), game.players.end(),
-                               [](Player *player) { return player->alive; });
-        if (it == game.players.end()) {
-          broadcast_game(game, "DRAW|");
-        } else {
-          broadcast_game(game, "WINS " + (*it)->nickname + "|");
+bool Server::tick_room(Game &game, bool catch_up) {
+  game.drain_inputs();
+  bool waiting =
+      std::any_of(game.players.begin(), game.players.end(),
+                  [](Player *player) { return !player->updated; });
+
+  if (waiting && catch_up)
+    return false;
+
+  if (waiting) {
+    MessageRef msg[2] = {encode_wait(game, false), encode_wait(game, true)};
+
+    // Only send WAIT to players who have updated
+    for (Player *player : game.players) {
+      if (player->updated) {
+        Connection *conn = connection_of(player);
+        if (conn) {
+          send_message(*conn, msg[conn->binary], true);
         }
-        game.active = false;
-      };
+      }
+    }
+    return false;
+  };
+
+  LOG_DEBUG(game.full_state());
+  LOG_DEBUG(game.current_move());
+  bool game_continues = game.slither();
+  broadcast_tick(game, !game_continues);
+  if (game_continues) {
+    LOG_DEBUG("-----");
+    game.print();
+    LOG_DEBUG("-----");
+  } else {
+    auto it = std::find_if(game.players.begin(), game.players.end(),
+                           [](Player *player) { return player->alive; });
+    if (it == game.players.end()) {
+      broadcast_game(game, MSG_DRAW);
+    } else {
+      broadcast_game(game, encode_wins(game, *it, false),
+                     encode_wins(game, *it, true));
+    }
+    game.active = false;
+    tick_scheduler.cancel(game);
+  };
+  return true;
+}
+
+void Server::start_ticking(Game &game) {
+  tick_scheduler.schedule(game, monotonic_ns());
+  this->arm_game_timer();
+}
+
+void Server::arm_game_timer() {
+  uint64_t deadline = tick_scheduler.next_deadline();
+  // an earlier pending expiry just finds nothing due and rearms
+  if (deadline == 0 ||
+      (armed_tick_deadline != 0 && armed_tick_deadline <= deadline))
+    return;
+
+  if (use_uring) {
+    this->uring_arm_game_timer(deadline);
+  } else {
+    itimerspec timer_spec = {};
+    timer_spec.it_value.tv_sec = deadline / 1000000000;
+    timer_spec.it_value.tv_nsec = deadline % 1000000000;
+    if (timerfd_settime(game_timer_fd, TFD_TIMER_ABSTIME, &timer_spec,
+                        nullptr) == -1) {
+      perror("timerfd_settime");
+      return;
     }
   }
+  armed_tick_deadline = deadline;
 }
 
 void Server::handle_timer() {
@@ -146,383 +492,698 @@ void Server::handle_timer() {
     perror("timerfd read");
     return;
   }
+  this->run_timer();
+}
 
-  // check for timeouts
-  std::vector<int> to_close;
-  for (auto &pair : connections) {
-    Connection &conn = *pair.second;
-    if (std::chrono::duration_cast<std::chrono::seconds>(
-            std::chrono::steady_clock::now() - conn.last_active)
-            .count() > CONNECTION_TIMEOUT) {
-      to_close.push_back(conn.socket);
-    }
-  }
-  for (int fd : to_close) {
-    this->close_connection(fd);
-  }
+void Server::run_timer() {
+  uint64_t now = this->wheel_now();
 
-  // removing inactive players
-  {
-    std::vector<Player *> to_remove;
-    for (auto &player : players) {
-      if (std::chrono::duration_cast<std::chrono::seconds>(
-              std::chrono::steady_clock::now() - player->last_active)
-              .count() > PLAYER_REMOVAL_TIMEOUT) {
-        to_remove.push_back(player.get());
-      }
-    }
+  // check for timeouts, only expired entries are visited
+  connection_timeouts.advance(now, [this](Connection *conn) {
+    metrics.evictions[EVICT_CONNECTION_TIMEOUT].add();
+    this->close_connection(conn->socket);
+  });
 
-    for (Player *p : to_remove) {
-      // Remove player from all rooms/games
-      for (auto &room : rooms) {
-        auto it = std::find(room.players.begin(), room.players.end(), p);
-        if (it != room.players.end()) {
-          room.players.erase(it);
-          std::string update_msg = "LOBY";
-          for (auto player : room.players) {
-            update_msg += " " + player->nickname;
-          }
-          update_msg += "|";
-          broadcast_game(room, update_msg);
-        }
-      }
-      auto it = std::find_if(
-          players.begin(), players.end(),
-          [p](const std::unique_ptr<Player> &ptr) { return ptr.get() == p; });
-      if (it != players.end()) {
-        players.erase(it);
-      }
-    }
-  }
+  // removing inactive players
+  player_timeouts.advance(now, [this](Player *player) {
+    metrics.evictions[EVICT_PLAYER_TIMEOUT].add();
+    this->remove_player(player);
+  });
 
   // ping connected clients
   if (std::chrono::duration_cast<std::chrono::seconds>(
           std::chrono::steady_clock::now() - this->last_ping)
           .count() > PING_INTERVAL) {
     for (auto &pair : connections) {
-      const char *ping_msg = "PING|";
-      send(pair.first, ping_msg, strlen(ping_msg), 0);
+      send_message(*pair.second, MSG_PING, true);
     }
     this->last_ping = std::chrono::steady_clock::now();
   }
+
+  this->refresh_metrics();
+}
+
+void Server::refresh_metrics() {
+  size_t backlog = 0;
+  size_t longest = 0;
+  for (auto &pair : connections) {
+    backlog += pair.second->backlog();
+    longest = std::max(longest, pair.second->backlog());
+  }
+  metrics.send_backlog.set(backlog);
+  metrics.send_backlog_max.set(longest);
+  metrics.connections.set(connections.size());
+  metrics.players.set(registry.size());
+  metrics.rooms.set(open_rooms.size());
+  metrics.games.set(std::count_if(open_rooms.begin(), open_rooms.end(),
+                                  [](Game *room) { return room->active; }));
 }
 
 void Server::handle_socket_read(int sock_fd) {
   auto it = connections.find(sock_fd);
   if (it == connections.end()) {
-    printf("socket file descriptor not in connections, this should not happen");
+    LOG_ERROR("Socket " << sock_fd
+                        << " not in connections, this should not happen");
     epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock_fd, nullptr);
     close(sock_fd);
     return;
   }
 
   Connection &conn = *(it->second);
-  std::string buff(1024, '\0');
-  ssize_t bytes_received = recv(sock_fd, &buff[0], buff.size(), 0);
+  size_t space = conn.input.reserve();
+  if (space == 0) {
+    // the buffer holds an incomplete message larger than it can ever fit
+    this->close_connection(sock_fd);
+    return;
+  }
+  ssize_t bytes_received = recv(sock_fd, conn.input.write_ptr(), space, 0);
 
+  if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
   if (bytes_received <= 0) {
     this->close_connection(sock_fd);
     return;
   }
+  conn.input.commit(bytes_received);
+  metrics.bytes_received.add(bytes_received);
 
-  buff.resize(bytes_received);
-  conn.buff.append(buff);
+  this->process_buffer(conn);
+}
+
+void Server::process_buffer(Connection &conn) {
+  // process whole messages, NICK may switch the encoding in between
+  while (!conn.closing && conn.migrate_to < 0) {
+    const char *data = conn.input.data();
+    size_t available = conn.input.size();
+    Request req;
+    if (conn.binary) {
+      size_t len = available < 2 ? 0 : get_u16(data);
+      if (available < 2 || available < 2 + len) {
+        if (conn.input.refill())
+          continue;
+        break;
+      }
+      int malformed = parse_binary_request(data + 2, len, req);
+      int opcode = len > 0 ? static_cast<uint8_t>(data[2]) : -1;
+      conn.input.consume(2 + len);
+      if (malformed) {
+        LOG_DEBUG("[" << conn.get_name() << "] : malformed, opcode "
+                      << opcode);
+        metrics.malformed.add();
+      } else {
+        LOG_DEBUG("[" << conn.get_name() << "] : opcode "
+                      << msg_type_name(req.type));
+        metrics.requests[req.type].add();
+      }
+      if (malformed || this->process_request(conn, req)) {
+        this->close_connection(conn.socket);
+        return;
+      }
+    } else {
+      if (available >= 4 &&
+          get_msg_type(std::string_view(data, 4)) == INVALID) {
+        metrics.malformed.add();
+        this->close_connection(conn.socket);
+        return;
+      }
+      const char *separator =
+          static_cast<const char *>(memchr(data, '|', available));
+      if (!separator) {
+        if (conn.input.refill())
+          continue;
+        break;
+      }
+      std::string_view msg(data, separator - data);
+      // the message stays valid until more data is received
+      conn.input.consume(msg.size() + 1);
+      if (this->process_message(conn, msg, req)) {
+        this->close_connection(conn.socket);
+        return;
+      }
+    }
 
-  // log
-  // std::cout << "[" << conn.get_name() << "] : " << buff << std::endl;
+    this->mark_active(conn);
+  }
 
-  if (conn.buff.size() < 4)
-    return;
-  if (get_msg_type(conn.buff.substr(0, 4)) == INVALID) {
+  if (conn.migrate_to >= 0) {
+    this->migrate_connection(conn);
+  } else if (!conn.closing && conn.input.has_deferred()) {
+    // an incomplete message fills the whole buffer
     this->close_connection(conn.socket);
+  }
+}
+
+void Server::receive_handoff(Handoff handoff) {
+  {
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    inbox.push_back(std::move(handoff));
+  }
+  uint64_t one = 1;
+  if (write(handoff_fd, &one, sizeof(one)) != sizeof(one))
+    perror("eventfd write");
+}
+
+void Server::handle_handoffs() {
+  uint64_t count;
+  if (read(handoff_fd, &count, sizeof(count)) != sizeof(count))
     return;
+
+  std::vector<Handoff> received;
+  {
+    std::lock_guard<std::mutex> lock(inbox_mutex);
+    received.swap(inbox);
+  }
+
+  for (Handoff &handoff : received) {
+    int fd = handoff.conn->socket;
+    Connection &conn = *handoff.conn;
+    connections[fd] = std::move(handoff.conn);
+    if (this->watch_connection(conn)) {
+      this->close_connection(fd);
+      continue;
+    }
+
+    if (handoff.player) {
+      bind_player(conn, this->add_player(std::move(handoff.player)));
+    }
+    this->mark_active(conn);
+
+    if (this->flush_connection(conn) ||
+        this->process_request(conn, handoff.request)) {
+      this->close_connection(fd);
+      continue;
+    }
+    if (conn.migrate_to >= 0) {
+      this->migrate_connection(conn);
+      continue;
+    }
+    this->process_buffer(conn);
   }
+}
 
-  size_t separator = conn.buff.find('|');
+void Server::migrate_connection(Connection &conn) {
+  int fd = conn.socket;
+  int target = conn.migrate_to;
 
-  // process whole messages
-  while (separator != std::string::npos) {
-    std::string msg = conn.buff.substr(0, separator);
-    conn.buff.erase(0, separator + 1);
-    if (this->process_message(conn, msg)) {
-      this->close_connection(conn.socket);
+  // on io_uring the receive has to be stopped and the pending send finished
+  // first, the completions call this again
+  if (use_uring) {
+    if (conn.recv_armed) {
+      this->unwatch_connection(conn);
+      return;
+    }
+    if (conn.send_in_flight)
       return;
-    };
+  } else {
+    this->unwatch_connection(conn);
+  }
+
+  // spectators are tracked by the reactor owning the room
+  this->stop_watching(conn);
+
+  // queued messages belong to this reactor's pool
+  conn.detach_queue();
+
+  Handoff handoff;
+  auto conn_it = connections.find(fd);
+  handoff.conn = std::move(conn_it->second);
+  connections.erase(conn_it);
+  handoff.request = std::move(conn.migrate_req);
+  conn.migrate_to = -1;
+  conn.want_write = false;
+  conn.timeout.unlink();
+
+  if (conn.player) {
+    handoff.player = this->take_player(conn.player);
+  }
+
+  LOG_DEBUG("Handing off " << conn.get_name() << " to reactor " << target);
+  cluster.handoff(target, std::move(handoff));
+}
+
+void Server::remove_from_rooms(Player *player) {
+  int room_id = registry.room_of(player);
+  if (room_id < 0)
+    return;
+  Game &room = *rooms[room_id];
+  room.remove_player(player);
+  registry.set_room(player, -1);
+  this->publish_room_size(room_id);
+  this->broadcast_lobby(room);
+
+  // pinned rooms stay open for clients that only know about them
+  if (room.players.empty() && room_id >= NUMBER_OF_ROOMS)
+    this->reclaim_room(room);
+}
+
+void Server::enter_room(Player *player, Game &room) {
+  this->remove_from_rooms(player);
+  room.add_player(player);
+  registry.set_room(player, room.id);
+  this->publish_room_size(room.id);
+  Connection *conn = connection_of(player);
+  if (conn)
+    this->send_board(*conn, room);
+  this->broadcast_lobby(room);
+}
+
+void Server::watch_room(Connection &conn, Game &room, int every) {
+  conn.watch_every = every;
+  if (conn.watching != room.id) {
+    this->stop_watching(conn);
+    conn.watching = room.id;
+    conn.watch_slot = room.spectators.size();
+    room.spectators.push_back(&conn);
+  }
+
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_WTCH, conn.binary);
+  if (conn.binary)
+    put_u16(buff, room.id);
+  else
+    append_int_field(buff, room.id);
+  end_message(buff, start, conn.binary);
+  send_message(conn, msg);
+
+  this->send_board(conn, room);
+  send_message(conn, encode_lobby(room, conn.binary));
+  if (room.active)
+    send_message(conn, encode_tick(room, tick_format_for(conn, room)));
+}
+
+void Server::stop_watching(Connection &conn) {
+  if (conn.watching < 0)
+    return;
+  std::vector<Connection *> &spectators = rooms[conn.watching]->spectators;
+  spectators[conn.watch_slot] = spectators.back();
+  spectators[conn.watch_slot]->watch_slot = conn.watch_slot;
+  spectators.pop_back();
+  conn.watching = -1;
+}
+
+void Server::send_board(Connection &conn, Game &room) {
+  // clients that never join a resized room do not need to know BORD
+  if (room.size == DEFAULT_GRID_SIZE)
+    return;
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_BORD, conn.binary);
+  if (conn.binary)
+    put_u16(buff, room.size);
+  else
+    append_int_field(buff, room.size);
+  end_message(buff, start, conn.binary);
+  send_message(conn, msg);
+}
+
+Game *Server::create_room(int room_id, int size) {
+  std::unique_ptr<Game> room;
+  if (room_pool.empty()) {
+    room = std::make_unique<Game>();
+  } else {
+    room = std::move(room_pool.back());
+    room_pool.pop_back();
+  }
+  room->id = room_id;
+  room->tick_ms = DEFAULT_TICK_MS;
+  if (size != room->size)
+    room->configure(size);
+  board_tiles += static_cast<size_t>(size) * size;
+  room->slot = open_rooms.size();
+  open_rooms.push_back(room.get());
+  rooms[room_id] = std::move(room);
+  return rooms[room_id].get();
+}
+
+void Server::reclaim_room(Game &room) {
+  int room_id = room.id;
+  open_rooms[room.slot] = open_rooms.back();
+  open_rooms[room.slot]->slot = room.slot;
+  open_rooms.pop_back();
+
+  tick_scheduler.cancel(room);
+  for (Connection *conn : room.spectators) {
+    conn->watching = -1;
+    send_message(*conn, MSG_LEFT);
+  }
+  room.spectators.clear();
+  board_tiles -= static_cast<size_t>(room.size) * room.size;
+  room.reset();
+  room_pool.push_back(std::move(rooms[room_id]));
+  cluster.room_sizes[room_id].store(0, std::memory_order_relaxed);
+  cluster.close_room(room_id);
+}
+
+void Server::publish_room_size(int room_id) {
+  cluster.room_sizes[room_id].store(rooms[room_id]->players.size(),
+                                    std::memory_order_relaxed);
+}
+
+MessageRef Server::encode_room_list(bool binary) {
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_ROOM, binary);
+  if (binary)
+    put_u16(buff, NUMBER_OF_ROOMS);
+  for (int i = 0; i < NUMBER_OF_ROOMS; i++) {
+    int players = cluster.room_sizes[i].load(std::memory_order_relaxed);
+    if (binary)
+      put_u8(buff, players);
+    else
+      append_int_field(buff, players);
+  }
+  end_message(buff, start, binary);
+  return msg;
+}
 
-    // mark the connection and its player as active
-    conn.last_active = std::chrono::steady_clock::now();
-    if (conn.player) {
-      conn.player->last_active = std::chrono::steady_clock::now();
+MessageRef Server::encode_room_page(int page, bool binary) {
+  int open = cluster.open_rooms.load(std::memory_order_relaxed);
+  int pages = std::max(1, (open + ROOM_PAGE_SIZE - 1) / ROOM_PAGE_SIZE);
+
+  MessageRef msg = message_pool.acquire();
+  std::string &buff = msg.buffer();
+  size_t start = begin_message(buff, MSG_ROMS, binary);
+  if (binary) {
+    put_u16(buff, page);
+    put_u16(buff, pages);
+  } else {
+    append_int_field(buff, page);
+    append_int_field(buff, pages);
+  }
+  size_t count_at = buff.size();
+  if (binary)
+    put_u8(buff, 0);
+
+  int skip = page * ROOM_PAGE_SIZE;
+  int listed = 0;
+  int room_count = cluster.room_sizes.size();
+  for (int i = 0; i < room_count && listed < ROOM_PAGE_SIZE; i++) {
+    if (!cluster.room_is_open(i) || skip-- > 0)
+      continue;
+    int players = cluster.room_sizes[i].load(std::memory_order_relaxed);
+    if (binary) {
+      put_u16(buff, i);
+      put_u8(buff, players);
+    } else {
+      append_int_field(buff, i);
+      append_int_field(buff, players);
     }
-    separator = conn.buff.find('|');
+    listed++;
   }
+  if (binary)
+    buff[count_at] = static_cast<char>(listed);
+  end_message(buff, start, binary);
+  return msg;
 }
 
-std::vector<std::string> split(const char *str, char c = ' ') {
-  std::vector<std::string> result;
+void Server::broadcast_lobby(Game &game) {
+  broadcast_game(game, encode_lobby(game, false), encode_lobby(game, true));
+}
 
-  do {
-    const char *begin = str;
+void Server::remove_player(Player *player) {
+  this->remove_from_rooms(player);
+  Connection *conn = connection_of(player);
+  if (conn) {
+    conn->player = nullptr;
+  }
+  cluster.release_nick(player->nickname, shard_id);
+  this->take_player(player);
+}
 
-    while (*str != c && *str)
-      str++;
+Player *Server::add_player(std::unique_ptr<Player> player) {
+  player_timeouts.schedule(player->timeout, PLAYER_REMOVAL_TIMEOUT + 1);
+  return registry.add(std::move(player));
+}
 
-    result.push_back(std::string(begin, str));
-  } while (0 != *str++);
+std::unique_ptr<Player> Server::take_player(Player *player) {
+  std::unique_ptr<Player> taken = registry.take(player);
+  taken->timeout.unlink();
+  return taken;
+}
 
-  return result;
+void Server::mark_active(Connection &conn) {
+  connection_timeouts.schedule(conn.timeout, CONNECTION_TIMEOUT + 1);
+  if (conn.player) {
+    player_timeouts.schedule(conn.player->timeout, PLAYER_REMOVAL_TIMEOUT + 1);
+  }
+}
+
+uint64_t Server::wheel_now() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::steady_clock::now() - started)
+      .count();
 }
 
-int Server::process_message(Connection &conn, std::string msg) {
-  std::cout << "[" << conn.get_name() << "] : " << msg << std::endl;
-  // std::cout << "rocessing message:" << msg << std::endl;
-  auto tokens = split(msg.data(), ' ');
-  // for (const auto &token : tokens) {
-  //   std::cout << "token: " << token << std::endl;
-  // }
-  if (tokens.size() < 1)
+int Server::process_message(Connection &conn, std::string_view msg,
+                            Request &req) {
+  LOG_DEBUG("[" << conn.get_name() << "] : " << msg);
+  if (parse_request(msg, req)) {
+    metrics.malformed.add();
     return 1;
+  }
+  metrics.requests[req.type].add();
+  return this->process_request(conn, req);
+}
 
-  msg_type type = get_msg_type(tokens[0]);
-  if (type != NICK && type != PONG && !conn.player)
+int Server::process_request(Connection &conn, Request &req) {
+  if (req.type != NICK && req.type != PONG && !conn.player)
     return 1;
 
-  switch (type) {
+  switch (req.type) {
   case OK:
   case WAITING:
   case PONG:
     // so far only to reset last_msg time
     break;
   case NICK: {
-
-    if (tokens.size() != 2 || conn.player)
+    if (conn.player)
       return 1;
 
+    // frames after this message use the negotiated encoding
+    conn.delta_ticks = req.delta;
+    conn.binary = req.binary;
 
-    std::string nick = tokens[1];
-    auto new_conn_player_it = std::find_if(
-        this->players.begin(), this->players.end(),
-        [nick](const auto &player) { return player->nickname == nick; });
-
-    if (new_conn_player_it == this->players.end()) {
-      players.push_back(std::make_unique<Player>(tokens[1]));
-      conn.player = players.back().get();
+    // a player with this nick may live on another reactor
+    int owner = cluster.claim_nick(req.nick, shard_id);
+    if (owner != shard_id) {
+      conn.migrate_to = owner;
+      conn.migrate_req = req;
+      break;
+    }
 
-      std::string reply = "ROOM";
-      for (const auto &room : rooms) {
-        reply += " " + std::to_string(room.players.size());
-      }
-      reply += "|";
-      send(conn.socket, reply.c_str(), reply.size(), 0);
+    Player *player = registry.find(req.nick);
+    if (!player) {
+      bind_player(conn, this->add_player(std::make_unique<Player>(req.nick)));
+      send_message(conn, encode_room_list(conn.binary));
     } else {
-      Player *player = new_conn_player_it->get();
-
       // check if a connection with the player exists and close is if it does
-      auto old_conn_it = std::find_if(
-          this->connections.begin(), this->connections.end(),
-          [nick](const auto &c) {
-            return c.second->player && c.second->player->nickname == nick;
-          });
-       
-      if (old_conn_it != this->connections.end()) {
-        this->close_connection(old_conn_it->second->socket);
+      Connection *old_conn = connection_of(player);
+      if (old_conn) {
+        this->close_connection(old_conn->socket);
       }
 
-      conn.player = player;
-      bool player_in_lobby = false;
-      for (auto &room : rooms) {
-        auto p_it = std::find(room.players.begin(), room.players.end(), player);
-        if (p_it != room.players.end()) {
-          player_in_lobby = true;
-          std::string reply = "LOBY";
-          for (auto p : room.players) {
-            reply += " " + p->nickname;
-          }
-          reply += "|";
-          send(conn.socket, reply.c_str(), reply.size(), 0);
-
-          if (room.active) {
-            std::string tick = "TICK " + room.full_state() + "|";
-            send(conn.socket, tick.c_str(), tick.size(), 0);
-          }
-        }
-      }
+      bind_player(conn, player);
+      int room_id = registry.room_of(player);
+      if (room_id >= 0) {
+        Game &room = *rooms[room_id];
+        this->send_board(conn, room);
+        send_message(conn, encode_lobby(room, conn.binary));
 
-      if (!player_in_lobby) {
-        std::string reply = "ROOM";
-        for (const auto &room : rooms) {
-          reply += " " + std::to_string(room.players.size());
+        if (room.active) {
+          conn.need_keyframe = true;
+          send_message(conn, encode_tick(room, tick_format_for(conn, room)));
         }
-        reply += "|";
-        send(conn.socket, reply.c_str(), reply.size(), 0);
+      } else {
+        send_message(conn, encode_room_list(conn.binary));
       }
     }
     break;
   }
   case LIST_ROOMS: {
-
-    if (tokens.size() != 1)
+    if (req.page < 0)
+      send_message(conn, encode_room_list(conn.binary));
+    else
+      send_message(conn, encode_room_page(req.page, conn.binary));
+  } break;
+  case JOIN: {
+    int room_id = req.room_id;
+    if (room_id >= static_cast<int>(rooms.size()) || room_id < 0)
       return 1;
 
-    std::string reply = "ROOM";
-    for (const auto &room : rooms) {
-      reply += " " + std::to_string(room.players.size());
+    if (!cluster.room_is_open(room_id)) {
+      send_message(conn, MSG_FULL);
+      return 0;
+    }
+
+    this->stop_watching(conn);
+
+    // the room lives on another reactor, move the player there
+    int owner = cluster.room_owner(room_id);
+    if (owner != shard_id) {
+      if (cluster.room_sizes[room_id].load(std::memory_order_relaxed) >=
+          MAX_PLAYERS_IN_ROOM) {
+        send_message(conn, MSG_FULL);
+        return 0;
+      }
+      this->remove_from_rooms(conn.player);
+      conn.migrate_to = owner;
+      conn.migrate_req = req;
+      break;
+    }
+
+    // the room may have been closed while the player was on the way
+    Game *room = rooms[room_id].get();
+    if (!room || room->players.size() >= MAX_PLAYERS_IN_ROOM) {
+      send_message(conn, MSG_FULL);
+      return 0;
+    }
+
+    // joining the current room again must not close it on the way
+    if (registry.room_of(conn.player) == room_id) {
+      this->broadcast_lobby(*room);
+      break;
     }
-    reply += "|";
-    send(conn.socket, reply.c_str(), reply.size(), 0);
+    this->enter_room(conn.player, *room);
   } break;
-  case JOIN: {
-    if (tokens.size() != 2)
+  case MAKE: {
+    if (req.tick_ms != 0 &&
+        (req.tick_ms < MIN_TICK_MS || req.tick_ms > MAX_TICK_MS))
+      return 1;
+    if (req.grid_size != 0 &&
+        (req.grid_size < MIN_GRID_SIZE || req.grid_size > MAX_GRID_SIZE))
+      return 1;
+    if (req.length != 0 &&
+        (req.length < MIN_INITIAL_LENGTH || req.length > MAX_INITIAL_LENGTH))
       return 1;
 
-    char *endptr = nullptr;
-    int room_id = std::strtol(tokens[1].c_str(), &endptr, 10);
-    if (*endptr != '\0' || room_id > NUMBER_OF_ROOMS || room_id < 0)
+    // large boards take megabytes each, a reactor only holds so many
+    int size = req.grid_size != 0 ? req.grid_size : DEFAULT_GRID_SIZE;
+    if (board_tiles + static_cast<size_t>(size) * size > BOARD_TILE_BUDGET) {
+      send_message(conn, MSG_FULL);
+      return 0;
+    }
+
+    // take an id owned by this reactor, the creator does not have to move
+    int room_id = cluster.open_room(shard_id);
+    if (room_id < 0) {
+      send_message(conn, MSG_FULL);
+      return 0;
+    }
+    this->stop_watching(conn);
+    Game *room = this->create_room(room_id, size);
+    if (req.tick_ms != 0)
+      room->tick_ms = req.tick_ms;
+    if (req.length != 0)
+      room->initial_length = req.length;
+
+    MessageRef made = message_pool.acquire();
+    std::string &buff = made.buffer();
+    size_t start = begin_message(buff, MSG_MADE, conn.binary);
+    if (conn.binary)
+      put_u16(buff, room_id);
+    else
+      append_int_field(buff, room_id);
+    end_message(buff, start, conn.binary);
+    send_message(conn, made);
+
+    this->enter_room(conn.player, *room);
+  } break;
+  case WATCH: {
+    int room_id = req.room_id;
+    if (room_id >= static_cast<int>(rooms.size()) || room_id < 0)
       return 1;
-    if (rooms[room_id].players.size() >= MAX_PLAYERS_IN_ROOM) {
-      const char *reply = "FULL|";
-      send(conn.socket, reply, strlen(reply), 0);
+    if (req.every < 0 || req.every > MAX_WATCH_EVERY)
+      return 1;
+
+    if (!cluster.room_is_open(room_id)) {
+      send_message(conn, MSG_FULL);
       return 0;
     }
 
-    // Remove player from any room they are in
-    for (auto &room : rooms) {
-      auto it =
-          std::find(room.players.begin(), room.players.end(), conn.player);
-      if (it != room.players.end()) {
-        room.players.erase(it);
-        std::string update_msg = "LOBY";
-        for (auto player : room.players) {
-          update_msg += " " + player->nickname;
-        }
-        update_msg += "|";
-        broadcast_game(room, update_msg);
-      }
+    // a spectator does not play, leaving may close the room to watch
+    this->remove_from_rooms(conn.player);
+
+    int owner = cluster.room_owner(room_id);
+    if (owner != shard_id) {
+      conn.migrate_to = owner;
+      conn.migrate_req = req;
+      break;
     }
 
-    rooms[room_id].players.push_back(conn.player);
-    std::string reply = "LOBY";
-    for (auto player : rooms[room_id].players) {
-      reply += " " + player->nickname;
+    Game *room = rooms[room_id].get();
+    if (!room) {
+      this->stop_watching(conn);
+      send_message(conn, MSG_FULL);
+      return 0;
     }
-    reply += "|";
-    broadcast_game(rooms[room_id], reply);
+    this->watch_room(conn, *room, req.every ? req.every : 1);
   } break;
-  case INVALID: {
-    // std::cout << "invalid message: [" << msg << "] from " << conn.get_name()
-    //           << std::endl;
+  case INVALID:
+  case MSG_TYPE_COUNT: {
     return 1;
   } break;
   case LEAVE: {
-    if (tokens.size() != 1)
-      return 1;
-
     // Remove player from any room they are in
-    for (auto &room : rooms) {
-      auto it =
-          std::find(room.players.begin(), room.players.end(), conn.player);
-      if (it != room.players.end()) {
-        room.players.erase(it);
-        std::string update_msg = "LOBY";
-        for (auto player : room.players) {
-          update_msg += " " + player->nickname;
-        }
-        update_msg += "|";
-        broadcast_game(room, update_msg);
-      }
-    }
-    const char *reply = "LEFT|";
-    send(conn.socket, reply, strlen(reply), 0);
+    this->stop_watching(conn);
+    this->remove_from_rooms(conn.player);
+    send_message(conn, MSG_LEFT);
   } break;
   case MOVE: {
-    if (tokens.size() != 2 || tokens[1].size() != 1)
+    if (req.dir >= DIRECTION_COUNT)
       return 1;
-
-    switch (tokens[1][0]) {
-    case 'U':
-      if (conn.player->last_move_dir != DOWN)
-        conn.player->dir = UP;
-      break;
-    case 'D':
-      if (conn.player->last_move_dir != UP)
-        conn.player->dir = DOWN;
-      break;
-    case 'L':
-      if (conn.player->last_move_dir != RIGHT)
-        conn.player->dir = LEFT;
-      break;
-    case 'R':
-      if (conn.player->last_move_dir != LEFT)
-        conn.player->dir = RIGHT;
-      break;
-    default:
+    // applied by the room on its next tick, a room without a game
+    // has no tick to apply them to
+    int room_id = registry.room_of(conn.player);
+    if (room_id >= 0 && rooms[room_id]->active &&
+        rooms[room_id]->push_input({conn.player, req.dir})) {
+      LOG_WARN("Input queue of room " << room_id << " full, closing: "
+                                      << conn.get_name());
+      metrics.evictions[EVICT_INPUT_FLOOD].add();
       return 1;
     }
-    const char *msg = "MOVD|";
-    send(conn.socket, msg, strlen(msg), 0);
+    send_message(conn, MSG_MOVD);
     break;
   }
   case START: {
-    if (tokens.size() != 1)
-      return 1;
-
-    auto game = std::find_if(
-        this->rooms.begin(), this->rooms.end(), [&conn](Game &game) {
-          return std::find(game.players.begin(), game.players.end(),
-                           conn.player) != game.players.end();
-        });
-
-    if (game == this->rooms.end()) {
-      std::cout << "Could not find game player is in";
+    int room_id = registry.room_of(conn.player);
+    if (room_id < 0) {
+      LOG_WARN("Could not find game player is in");
       return 1;
     }
+    Game *game = rooms[room_id].get();
 
-    int hatch_failed = game->hatch();
+    uint64_t seed = seeds.next();
+    int hatch_failed = game->hatch(seed);
     if (hatch_failed) {
-      const char *reply = "STRT FAIL|";
-      send(conn.socket, reply, strlen(reply), 0);
+      send_message(conn, MSG_STRT_FAIL);
       break;
     }
     game->active = true;
     game->print();
+    if (!record_dir.empty()) {
+      std::string path = record_dir + "/room" + std::to_string(room_id) +
+                         "-" + std::to_string(seed) + ".snkm";
+      if (game->record(path, seed) == 0)
+        LOG_INFO("Recording room " << room_id << " to " << path);
+    }
 
-    const char *reply = "STRT OK|";
-    send(conn.socket, reply, strlen(reply), 0);
-    broadcast_game(*game, "TICK " + game->full_state() + "|");
+    send_message(conn, MSG_STRT_OK);
+    broadcast_tick(*game);
+    this->start_ticking(*game);
   } break;
   case TACK: {
-    conn.player->updated = true;
+    int room_id = registry.room_of(conn.player);
+    if (room_id >= 0)
+      rooms[room_id]->acknowledge(conn.player);
+  } break;
+  case SYNC: {
+    conn.need_keyframe = true;
   } break;
   case QUIT: {
-
-    if (tokens.size() != 1)
-      return 1;
-
-    // Remove player from any room they are in
-    for (auto &room : rooms) {
-      auto it =
-          std::find(room.players.begin(), room.players.end(), conn.player);
-      if (it != room.players.end()) {
-        room.players.erase(it);
-        std::string update_msg = "LOBY";
-        for (auto player : room.players) {
-          update_msg += " " + player->nickname;
-        }
-        update_msg += "|";
-        broadcast_game(room, update_msg);
-      }
-    }
-
-    // remove player from the server vector
-    auto it = std::find_if(this->players.begin(), this->players.end(),
-                           [&conn](const std::unique_ptr<Player> &p) {
-                             return p.get() == conn.player;
-                           });
-    if (it != this->players.end()) {
-      this->players.erase(it);
-    }
-
-    this->close_connection(conn.socket);
+    // Remove player from any room they are in and from the server
+    this->remove_player(conn.player);
+    this->schedule_close(conn);
 
   } break;
   }
@@ -546,10 +1207,18 @@ void Server::close_connection(int sock_fd) {
   auto it = connections.find(sock_fd);
   if (it == connections.end())
     return;
-  std::cout << "Closing connection with: " << it->second->get_name()
-            << std::endl;
-  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, sock_fd, nullptr);
+  LOG_INFO("Closing connection with: " << it->second->get_name());
+  Player *player = it->second->player;
+  if (player)
+    registry.unbind(player, it->second.get());
+  this->stop_watching(*it->second);
+  this->unwatch_connection(*it->second);
+  it->second->timeout.unlink();
   close(sock_fd);
+
+  // the kernel may still be reading the buffer of a pending send
+  if (it->second->send_in_flight)
+    orphans.push_back(std::move(it->second));
   connections.erase(sock_fd);
 }
 
@@ -564,28 +1233,36 @@ void Server::handle_new_connection() {
     return;
   }
 
+  this->add_connection(client_socket, client_addr);
+}
+
+void Server::add_connection(int client_socket, sockaddr_in client_addr) {
   if (set_nonblocking(client_socket) != 0) {
-    std::cerr << "Failed to set non-blocking for client" << std::endl;
+    LOG_ERROR("Failed to set non-blocking for client");
     close(client_socket);
     return;
   }
+  // ticks are small frames sent right after other small frames, Nagle
+  // would hold them until the client's delayed ACK
+  int nodelay = 1;
+  setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay,
+             sizeof(nodelay));
   auto res = connections.emplace(
       client_socket,
-      std::make_unique<Connection>(Connection(client_socket, client_addr)));
+      std::make_unique<Connection>(client_socket, client_addr));
   if (!res.second) {
-    std::cerr << "Error: Connection already exists for fd " << client_socket
-              << std::endl;
+    LOG_ERROR("Connection already exists for fd " << client_socket);
     close(client_socket);
     return;
   }
 
   // add fd to pool
-  if (Server::add_fd_to_epoll(client_socket)) {
+  if (this->watch_connection(*res.first->second)) {
     throw std::runtime_error("Could not add to epoll pool");
   }
+  this->mark_active(*res.first->second);
 
-  std::cout << "Client connected: " << res.first->second->get_name()
-            << std::endl;
+  LOG_INFO("Client connected: " << res.first->second->get_name());
 }
 
 void Server::setup() {
@@ -593,9 +1270,11 @@ void Server::setup() {
   if (server_socket == -1)
     throw std::runtime_error("socket");
 
+  // every reactor binds its own socket to the same port, the kernel
+  // balances incoming connections between them
   int opt = 1;
-  if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt,
-                 sizeof(opt))) {
+  if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+      setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
     perror("setsockopt");
   }
 
@@ -606,10 +1285,15 @@ void Server::setup() {
   if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)))
     throw std::runtime_error("bind");
 
-  if (listen(server_socket, 10))
+  if (listen(server_socket, SOMAXCONN))
     throw std::runtime_error("listen");
 
-  std::cout << "Listening on: " << ip_address << ":" << port << std::endl;
+  LOG_INFO("Listening on: " << ip_address << ":" << port << " (reactor "
+                            << shard_id << ")");
+
+  // the io_uring backend replaces epoll and the timer file descriptors
+  if (use_uring)
+    return;
 
   epoll_fd = epoll_create1(0);
   if (epoll_fd == -1)
@@ -634,19 +1318,35 @@ void Server::setup() {
     perror("timer_fd");
     return;
   }
-  timer_spec.it_interval.tv_sec = GAME_SPEED;
-  timer_spec.it_interval.tv_nsec = 0;
-  timer_spec.it_value.tv_sec = GAME_SPEED;
-  timer_spec.it_value.tv_nsec = 0;
-  timerfd_settime(game_timer_fd, 0, &timer_spec, nullptr);
+  // one-shot, armed for the earliest room tick by arm_game_timer
 
-  // add timer fd to pool
+  // add timer and handoff fds to pool
   if (Server::add_fd_to_epoll(global_timer_fd) ||
-      Server::add_fd_to_epoll(game_timer_fd)) {
+      Server::add_fd_to_epoll(game_timer_fd) ||
+      Server::add_fd_to_epoll(handoff_fd)) {
     throw std::runtime_error("Could not add to epoll pool");
   }
 }
 
+int Server::watch_connection(Connection &conn) {
+  conn.want_write = false;
+  if (use_uring) {
+    conn.generation = next_generation++;
+    this->uring_arm_recv(conn);
+    return 0;
+  }
+  return this->add_fd_to_epoll(conn.socket);
+}
+
+void Server::unwatch_connection(Connection &conn) {
+  if (use_uring) {
+    if (conn.recv_armed && !conn.recv_cancelled)
+      this->uring_cancel_recv(conn);
+    return;
+  }
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.socket, nullptr);
+}
+
 int Server::set_nonblocking(int sockfd) {
   int flags = fcntl(sockfd, F_GETFL, 0);
   if (flags == -1) {
@@ -669,6 +1369,60 @@ int main(int argc, char **argv) {
   if (argc > 2) {
     ip = argv[2];
   }
-  Server server(port, ip);
-  server.serve();
+  int reactors = 1;
+  if (argc > 3) {
+    reactors = std::max(1, std::stoi(argv[3]));
+  }
+  bool use_uring = false;
+  if (argc > 4) {
+    use_uring = std::string(argv[4]) == "uring";
+  }
+  int max_rooms = DEFAULT_MAX_ROOMS;
+  if (argc > 5) {
+    max_rooms = std::clamp(std::stoi(argv[5]), NUMBER_OF_ROOMS, MAX_ROOMS);
+  }
+  std::string record_dir;
+  if (argc > 6) {
+    record_dir = argv[6];
+  }
+  int admin_port = 0;
+  if (argc > 7) {
+    admin_port = std::stoi(argv[7]);
+  }
+  log_level level = LEVEL_INFO;
+  if (argc > 8 && Logger::parse_level(argv[8], level)) {
+    std::cerr << "Unknown log level: " << argv[8] << std::endl;
+    return 1;
+  }
+  Logger::instance().set_level(level);
+  Logger::instance().start();
+  if (!record_dir.empty())
+    MatchLogWriter::instance().start();
+
+  Cluster cluster(reactors, max_rooms, NUMBER_OF_ROOMS);
+  std::vector<std::unique_ptr<Server>> servers;
+  for (int i = 0; i < reactors; i++) {
+    servers.push_back(std::make_unique<Server>(port, ip, cluster, i));
+    servers.back()->use_uring = use_uring;
+    servers.back()->record_dir = record_dir;
+    cluster.shards.push_back(servers.back().get());
+  }
+
+  std::vector<const Metrics *> metrics;
+  for (auto &server : servers)
+    metrics.push_back(&server->metrics);
+  AdminServer admin(metrics);
+  if (admin_port > 0 && admin.start(admin_port))
+    return 1;
+
+  // reactor 0 runs on the main thread
+  std::vector<std::thread> threads;
+  for (int i = 1; i < reactors; i++) {
+    threads.emplace_back([&servers, i]() { servers[i]->serve(); });
+  }
+  int res = servers[0]->serve();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return res;
 }
\ No newline at end of file
@@ -1,21 +1,47 @@
 #ifndef SERVER_HPP
 #define SERVER_HPP
 
+#include "cluster.hpp"
 #include "connection.hpp"
 #include "game.hpp"
+#include "metrics.hpp"
+#include "protocol.hpp"
+#include "registry.hpp"
+#include "tick_scheduler.hpp"
+#include "timing_wheel.hpp"
+#include "uring.hpp"
 #include <chrono>
 #include <memory>
+#include <mutex>
 #include <netinet/in.h>
 #include <string>
+#include <string_view>
 #include <sys/epoll.h>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#define NUMBER_OF_ROOMS 4
+#define DEFAULT_MAX_ROOMS 4096
+/// Binary frames carry room ids as u16.
+#define MAX_ROOMS 65536
+#define GLOBAL_TIMER_CHECK 1
+#define DEFAULT_TICK_MS 1000
+#define MIN_TICK_MS 50
+#define MAX_TICK_MS 10000
+#define MAX_WATCH_EVERY 100
+/// Tiles of all boards open on a reactor. A running game takes about 30
+/// bytes per tile with four players, so this bounds a reactor to roughly
+/// 120 MB of boards.
+#define BOARD_TILE_BUDGET (4 * MAX_GRID_SIZE * MAX_GRID_SIZE)
+
 /**
  * @brief Main server class for multiplayer snake game
  *
  * Handles network connections, pooling, lobby state, game loop, and message
- * broadcasting.
+ * broadcasting. Each instance is one reactor of a Cluster, owning its own
+ * listening socket, epoll instance, connections, players and the rooms
+ * assigned to it.
  */
 class Server {
 public:
@@ -24,8 +50,11 @@ public:
    *
    * @param port Port number to listen on.
    * @param ip_address IP address to bind to.
+   * @param cluster The cluster this reactor belongs to.
+   * @param shard_id Index of this reactor in the cluster.
    */
-  Server(int port, const std::string &ip_address);
+  Server(int port, const std::string &ip_address, Cluster &cluster,
+         int shard_id);
 
   /**
    * @brief Starts the server loop.
@@ -48,11 +77,33 @@ public:
    * @brief Processes a received message from a client.
    *
    * @param conn The connection object representing the client.
-   * @param msg The message string received.
+   * @param msg The message string received, without the delimiter.
+   * @param req Storage for the decoded message.
+   * @return int 0 on success, non-zero on error indicating connection should be
+   * closed.
+   */
+  int process_message(Connection &conn, std::string_view msg, Request &req);
+
+  /**
+   * @brief Handles a decoded message from a client.
+   *
+   * @param conn The connection object representing the client.
+   * @param req The decoded message.
    * @return int 0 on success, non-zero on error indicating connection should be
    * closed.
    */
-  int process_message(Connection &conn, std::string msg);
+  int process_request(Connection &conn, Request &req);
+
+  /**
+   * @brief Starts the server loop on the io_uring backend.
+   *
+   * Uses multishot accept, multishot receive into provided buffers, sends
+   * batched into one submission per loop iteration and absolute timeout
+   * entries instead of the timer file descriptors.
+   *
+   * @return int 0 on success, 1 on error.
+   */
+  int serve_uring();
 
   /**
    * @brief Handles global timer events, player and connection timeouts and
@@ -60,6 +111,18 @@ public:
    */
   void handle_timer();
 
+  /**
+   * @brief Checks player and connection timeouts and pings clients.
+   *
+   * Called once per GLOBAL_TIMER_CHECK by either backend.
+   */
+  void run_timer();
+
+  /**
+   * @brief Updates the gauges of the metrics, called by run_timer.
+   */
+  void refresh_metrics();
+
   /**
    * @brief Handles game tick timer events.
    *
@@ -67,6 +130,39 @@ public:
    */
   void handle_game_tick();
 
+  /**
+   * @brief Runs the ticks of all rooms that are due and rearms the timer.
+   *
+   * Called by either backend when the game timer expires.
+   */
+  void run_game_tick();
+
+  /**
+   * @brief Advances a game by one tick and broadcasts the state.
+   *
+   * While some player has not acknowledged the last tick the game does not
+   * advance, the players who did are sent WAIT instead.
+   *
+   * @param game The active game.
+   * @param catch_up Whether this makes up for a missed tick, such a tick
+   * only returns false while waiting and sends no WAIT.
+   * @return true if the game advanced, false if it waits for a player.
+   */
+  bool tick_room(Game &game, bool catch_up);
+
+  /**
+   * @brief Starts the ticks of a game that has just been hatched.
+   *
+   * @param game The game.
+   */
+  void start_ticking(Game &game);
+
+  /**
+   * @brief Sets the game timer to the earliest tick deadline if it is not
+   * armed for an earlier one.
+   */
+  void arm_game_timer();
+
   /**
    * @brief Handles read events on a socket.
    *
@@ -76,6 +172,259 @@ public:
    */
   void handle_socket_read(int sock_fd);
 
+  /**
+   * @brief Handles write events on a socket.
+   *
+   * Drains the connection's send backlog once the socket is writable again.
+   *
+   * @param sock_fd The file descriptor that is ready for writing.
+   */
+  void handle_socket_write(int sock_fd);
+
+  /**
+   * @brief Queues a message without arguments for sending to a client.
+   *
+   * @param conn The connection to send the message to.
+   * @param type The message, encoded as the client negotiated.
+   * @param droppable Whether the message may be skipped for a lagging client.
+   */
+  void send_message(Connection &conn, server_msg type,
+                    bool droppable = false);
+
+  /**
+   * @brief Queues an encoded message for sending to a client.
+   *
+   * The message is queued by reference, it can be shared by many
+   * connections. It is written as far as the socket allows, the rest is
+   * sent on EPOLLOUT. Droppable messages are skipped for clients whose
+   * backlog exceeds SEND_BACKLOG_DEGRADE, a client exceeding
+   * SEND_BACKLOG_LIMIT is disconnected.
+   *
+   * @param conn The connection to send the message to.
+   * @param msg The message to send.
+   * @param droppable Whether the message may be skipped for a lagging client.
+   */
+  void send_message(Connection &conn, const MessageRef &msg,
+                    bool droppable = false);
+
+  /**
+   * @brief Writes as much of the connection's output buffer as possible.
+   *
+   * Registers or unregisters EPOLLOUT depending on the remaining backlog,
+   * on the io_uring backend queues a send of the backlog instead.
+   *
+   * @param conn The connection to flush.
+   * @return int 0 on success, -1 on socket error.
+   */
+  int flush_connection(Connection &conn);
+
+  /**
+   * @brief Schedules a connection to be closed after the current event.
+   *
+   * Used where closing immediately would invalidate references still in use.
+   *
+   * @param conn The connection to close.
+   */
+  void schedule_close(Connection &conn);
+
+  /**
+   * @brief Closes all connections scheduled by schedule_close.
+   */
+  void close_pending();
+
+  /**
+   * @brief Processes all complete messages in the connection's input buffer.
+   *
+   * @param conn The connection to process.
+   */
+  void process_buffer(Connection &conn);
+
+  /**
+   * @brief Queues a connection handed off by another reactor.
+   *
+   * Thread safe, called from the sending reactor's thread.
+   *
+   * @param handoff The connection, player and message to replay.
+   */
+  void receive_handoff(Handoff handoff);
+
+  /**
+   * @brief Adopts all connections queued by receive_handoff.
+   */
+  void handle_handoffs();
+
+  /**
+   * @brief Detaches a connection and hands it to the reactor in
+   * conn.migrate_to.
+   *
+   * The connection must not be used after this call.
+   *
+   * @param conn The connection to migrate.
+   */
+  void migrate_connection(Connection &conn);
+
+  /**
+   * @brief Removes a player from the room they are in and notifies the rest
+   * of the room.
+   *
+   * @param player The player to remove.
+   */
+  void remove_from_rooms(Player *player);
+
+  /**
+   * @brief Moves a player into a room and notifies the room.
+   *
+   * @param player The player, leaves its current room first.
+   * @param room The room to enter, owned by this reactor.
+   */
+  void enter_room(Player *player, Game &room);
+
+  /**
+   * @brief Makes a connection a spectator of a room, or changes its rate.
+   *
+   * The spectator gets the room's lobby and state right away and then the
+   * broadcasts of the room, but is not a player of it.
+   *
+   * @param conn The connection, its player must not be in a room.
+   * @param room The room to watch, owned by this reactor.
+   * @param every Send every nth tick.
+   */
+  void watch_room(Connection &conn, Game &room, int every);
+
+  /**
+   * @brief Stops a connection from watching its room.
+   *
+   * @param conn The connection, may not be watching.
+   */
+  void stop_watching(Connection &conn);
+
+  /**
+   * @brief Sends the BORD message if the room has a non-default board.
+   *
+   * @param conn The connection to send to.
+   * @param room The room the player is in.
+   */
+  void send_board(Connection &conn, Game &room);
+
+  /**
+   * @brief Opens a room on this reactor, reusing a pooled Game if possible.
+   *
+   * @param room_id The room identifier, owned by this reactor.
+   * @param size Board size of the room.
+   * @return Game* The new room.
+   */
+  Game *create_room(int room_id, int size = DEFAULT_GRID_SIZE);
+
+  /**
+   * @brief Closes an empty room and returns it to the pool.
+   *
+   * @param room The room to close.
+   */
+  void reclaim_room(Game &room);
+
+  /**
+   * @brief Updates the room's player count visible to all reactors.
+   *
+   * @param room_id The room identifier.
+   */
+  void publish_room_size(int room_id);
+
+  /**
+   * @brief Builds the ROOM message with player counts of all rooms.
+   *
+   * @param binary Whether to encode a binary frame.
+   * @return MessageRef The encoded message.
+   */
+  MessageRef encode_room_list(bool binary);
+
+  /**
+   * @brief Builds a ROMS message with one page of the open rooms.
+   *
+   * @param page The page number, starting at 0.
+   * @param binary Whether to encode a binary frame.
+   * @return MessageRef The encoded message.
+   */
+  MessageRef encode_room_page(int page, bool binary);
+
+  /**
+   * @brief Builds the LOBY message with the players of a room.
+   *
+   * The binary frame lists the nicks in room order, which assigns the ids
+   * used by other binary messages.
+   *
+   * @param game The room.
+   * @param binary Whether to encode a binary frame.
+   * @return MessageRef The encoded message.
+   */
+  MessageRef encode_lobby(Game &game, bool binary);
+
+  /**
+   * @brief Builds the WAIT message with the players not acknowledging a tick.
+   *
+   * @param game The room.
+   * @param binary Whether to encode a binary frame.
+   * @return MessageRef The encoded message.
+   */
+  MessageRef encode_wait(Game &game, bool binary);
+
+  /**
+   * @brief Builds the WINS message.
+   *
+   * @param game The room.
+   * @param winner The winning player.
+   * @param binary Whether to encode a binary frame.
+   * @return MessageRef The encoded message.
+   */
+  MessageRef encode_wins(Game &game, Player *winner, bool binary);
+
+  /**
+   * @brief Get a message without arguments.
+   *
+   * These never change, each encoding is built once per reactor.
+   *
+   * @param type The message.
+   * @param binary Whether to encode a binary frame.
+   * @return const MessageRef& The encoded message.
+   */
+  const MessageRef &simple_message(server_msg type, bool binary);
+
+  /**
+   * @brief Removes a player from the server and releases their nickname.
+   *
+   * @param player The player to remove.
+   */
+  void remove_player(Player *player);
+
+  /**
+   * @brief Adds a player to this reactor and starts its removal timeout.
+   *
+   * @param player The player.
+   * @return Player* The added player.
+   */
+  Player *add_player(std::unique_ptr<Player> player);
+
+  /**
+   * @brief Takes a player out of this reactor in O(1).
+   *
+   * @param player The player.
+   * @return std::unique_ptr<Player> The player, no longer scheduled.
+   */
+  std::unique_ptr<Player> take_player(Player *player);
+
+  /**
+   * @brief Restarts the inactivity timeouts of a connection and its player.
+   *
+   * @param conn The connection that received a message.
+   */
+  void mark_active(Connection &conn);
+
+  /**
+   * @brief Get the current tick of the timeout wheels.
+   *
+   * @return uint64_t Seconds since the reactor was created.
+   */
+  uint64_t wheel_now();
+
   /**
    * @brief Handles incoming connection requests.
    *
@@ -83,6 +432,87 @@ public:
    */
   void handle_new_connection();
 
+  /**
+   * @brief Registers an accepted client socket as a new connection.
+   *
+   * @param client_socket The accepted socket.
+   * @param client_addr The address of the client.
+   */
+  void add_connection(int client_socket, sockaddr_in client_addr);
+
+  /**
+   * @brief Starts watching a connection's socket for incoming data.
+   *
+   * @param conn The connection to watch.
+   * @return int 0 on success, -1 on error.
+   */
+  int watch_connection(Connection &conn);
+
+  /**
+   * @brief Stops watching a connection's socket for incoming data.
+   *
+   * @param conn The connection to stop watching.
+   */
+  void unwatch_connection(Connection &conn);
+
+  /**
+   * @brief Queues a multishot receive for a connection (io_uring backend).
+   *
+   * @param conn The connection to receive from.
+   */
+  void uring_arm_recv(Connection &conn);
+
+  /**
+   * @brief Rearms the receives that ran out of provided buffers, once
+   * buffers went back to the kernel (io_uring backend).
+   *
+   * Call before each submission.
+   */
+  void uring_rearm_starved();
+
+  /**
+   * @brief Asks the kernel to stop a connection's multishot receive
+   * (io_uring backend).
+   *
+   * @param conn The connection to stop receiving from.
+   */
+  void uring_cancel_recv(Connection &conn);
+
+  /**
+   * @brief Queues a send of the connection's backlog (io_uring backend).
+   *
+   * @param conn The connection to send to.
+   */
+  void uring_send(Connection &conn);
+
+  /**
+   * @brief Queues an absolute timeout for one of the server timers
+   * (io_uring backend).
+   *
+   * @param kind Which timer the timeout belongs to.
+   * @param deadline The deadline, advanced by interval_sec.
+   * @param interval_sec The timer period in seconds.
+   */
+  void uring_arm_timeout(int kind, __kernel_timespec &deadline,
+                         int interval_sec);
+
+  /**
+   * @brief Queues the game timeout for a tick deadline, or moves the
+   * pending one (io_uring backend).
+   *
+   * @param deadline The deadline in nanoseconds.
+   */
+  void uring_arm_game_timer(uint64_t deadline);
+
+  /**
+   * @brief Handles one io_uring completion.
+   *
+   * @param user_data The request identification.
+   * @param res The result of the request.
+   * @param flags The completion flags.
+   */
+  void handle_completion(uint64_t user_data, int res, uint32_t flags);
+
   /**
    * @brief Sets up the server socket and resources.
    *
@@ -100,12 +530,85 @@ public:
   void close_connection(int sock_fd);
 
   /**
-   * @brief Broadcasts a message to all players in a specific game room.
+   * @brief Broadcasts an encoded message to all players and spectators in a
+   * game room.
+   *
+   * Each encoding is built once and shared by all recipients using it.
    *
    * @param game The game instance to broadcast to.
-   * @param msg The message to send.
+   * @param text The message for text clients.
+   * @param binary The message for binary clients.
+   * @param droppable Whether the message may be skipped for lagging clients.
+   */
+  void broadcast_game(Game &game, const MessageRef &text,
+                      const MessageRef &binary, bool droppable = false);
+
+  /**
+   * @brief Broadcasts a message without arguments to all players and
+   * spectators in a room.
+   *
+   * @param game The game instance to broadcast to.
+   * @param type The message.
+   */
+  void broadcast_game(Game &game, server_msg type);
+
+  /**
+   * @brief Sends the LOBY message to all players in a room.
+   *
+   * @param game The room.
+   */
+  void broadcast_lobby(Game &game);
+
+  /**
+   * @brief Encodes the state of a game after a tick.
+   *
+   * @param game The game to encode.
+   * @param format The encoding to use.
+   * @return MessageRef The pooled message.
+   */
+  MessageRef encode_tick(Game &game, tick_format format = TICK_FULL);
+
+  /**
+   * @brief Picks the tick encoding a connection should receive.
+   *
+   * A pending keyframe request is cleared once a keyframe is chosen.
+   * Spectators skip ticks, so they always get the full state.
+   *
+   * @param conn The receiving connection.
+   * @param game The game being broadcast.
+   * @return tick_format The encoding to send.
+   */
+  tick_format tick_format_for(Connection &conn, Game &game);
+
+  /**
+   * @brief Sends the current game state to all players and spectators of a
+   * game.
+   *
+   * Each encoding is produced at most once and shared by the connections
+   * using it. The players are served first, spectators get only every nth
+   * tick they asked for and are skipped while lagging.
+   *
+   * @param game The game to broadcast.
+   * @param last Whether the game ended with this tick, every spectator
+   * gets it.
+   */
+  void broadcast_tick(Game &game, bool last = false);
+
+  /**
+   * @brief Finds the connection a player is currently bound to.
+   *
+   * @param player The player to look up.
+   * @return Connection* The player's connection, nullptr if disconnected.
+   */
+  Connection *connection_of(Player *player);
+
+  /**
+   * @brief Binds a player to a connection, replacing any previous binding.
+   *
+   * @param conn The connection the player logged in on.
+   * @param player The player to bind.
    */
-  void broadcast_game(Game &game, std::string msg);
+  void bind_player(Connection &conn, Player *player);
 
   /**
    * @brief Sets a socket to non-blocking mode.
@@ -116,6 +619,11 @@ public:
   static int set_nonblocking(int sockfd);
 
   // Members
+  Cluster &cluster;
+  int shard_id;
+  int handoff_fd;
+  std::mutex inbox_mutex;
+  std::vector<Handoff> inbox;
   int port;
   int server_socket;
   int epoll_fd;
@@ -124,10 +632,35 @@ public:
   std::string ip_address;
   sockaddr_in server_addr;
   struct epoll_event event, events[10];
-  std::vector<Game> rooms;
-  std::vector<std::unique_ptr<Player>> players;
+  std::vector<std::unique_ptr<Game>> rooms; ///< By id, null if not open here.
+  std::vector<Game *> open_rooms;             ///< Rooms open on this reactor.
+  std::vector<std::unique_ptr<Game>> room_pool; ///< Reset rooms for reuse.
+  size_t board_tiles; ///< Tiles of the open rooms, within BOARD_TILE_BUDGET.
+  TimingWheel<Connection> connection_timeouts;
+  TimingWheel<Player> player_timeouts;
+  TickScheduler tick_scheduler;
+  uint64_t armed_tick_deadline; ///< Deadline the game timer is set to, 0 if none.
+  std::chrono::steady_clock::time_point started;
+  Registry registry;
   std::chrono::steady_clock::time_point last_ping;
+  Rng seeds;              ///< Draws the seed of every match.
+  std::string record_dir; ///< Directory of the match logs, empty if off.
+  Metrics metrics;        ///< Read by the admin thread.
+  MessagePool message_pool;
+  MessageRef simple_messages[2][SERVER_MSG_COUNT];
   std::unordered_map<int, std::unique_ptr<Connection>> connections;
+  std::vector<int> pending_close;
+  bool use_uring;
+  std::unique_ptr<Uring> uring;
+  uint32_t next_generation;
+  /// Connections (fd, generation) whose receive stopped on ENOBUFS.
+  std::vector<std::pair<int, uint32_t>> starved_recvs;
+  uint64_t starved_since; ///< Returned buffers the starved receives await.
+  /// Buffers returned at the previous and the last submission.
+  uint64_t returned_at_submit[2];
+  __kernel_timespec global_deadline;
+  __kernel_timespec tick_deadline;
+  std::vector<std::unique_ptr<Connection>> orphans;
 };
 
 #endif // SERVER_HPP
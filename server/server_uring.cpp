@@ -0,0 +1,374 @@
+#include "server.hpp"
+#include "log.hpp"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define URING_ENTRIES 256
+#define URING_BUFFER_COUNT 256
+#define URING_BUFFER_SIZE 1024
+#define URING_BUFFER_GROUP 0
+
+/**
+ * @brief Kinds of requests submitted to the ring, stored in the top byte of
+ * the user data.
+ */
+enum uring_op {
+  OP_ACCEPT,
+  OP_RECV,
+  OP_SEND,
+  OP_CANCEL,
+  OP_GLOBAL_TIMER,
+  OP_GAME_TIMER,
+  OP_HANDOFF,
+};
+
+static uint64_t pack_user_data(uring_op op, uint32_t generation, int fd) {
+  return (static_cast<uint64_t>(op) << 56) |
+         (static_cast<uint64_t>(generation & 0xffffff) << 32) |
+         static_cast<uint32_t>(fd);
+}
+
+static uring_op user_data_op(uint64_t user_data) {
+  return static_cast<uring_op>(user_data >> 56);
+}
+
+static uint32_t user_data_generation(uint64_t user_data) {
+  return (user_data >> 32) & 0xffffff;
+}
+
+static int user_data_fd(uint64_t user_data) {
+  return static_cast<int>(user_data & 0xffffffff);
+}
+
+int Server::serve_uring() {
+  try {
+    uring = std::make_unique<Uring>(URING_ENTRIES);
+    uring->setup_buffers(URING_BUFFER_GROUP, URING_BUFFER_COUNT,
+                         URING_BUFFER_SIZE);
+  } catch (const std::exception &e) {
+    LOG_WARN("io_uring unavailable (" << e.what()
+                                      << "), falling back to epoll");
+    uring.reset();
+    use_uring = false;
+    return this->serve();
+  }
+
+  try {
+    this->setup();
+
+    io_uring_sqe *sqe = uring->get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = pack_user_data(OP_ACCEPT, 0, server_socket);
+
+    sqe = uring->get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = handoff_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = pack_user_data(OP_HANDOFF, 0, handoff_fd);
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    global_deadline = {now.tv_sec, now.tv_nsec};
+    this->uring_arm_timeout(OP_GLOBAL_TIMER, global_deadline,
+                            GLOBAL_TIMER_CHECK);
+
+    while (true) {
+      uring->retry_recycles();
+      this->uring_rearm_starved();
+      // everything queued while handling the last batch of completions,
+      // including all sends of a game tick, goes to the kernel in one call
+      int res = uring->submit_and_wait(1);
+      if (res < 0 && res != -EBUSY)
+        throw std::runtime_error("io_uring_enter");
+
+      io_uring_cqe *cqe;
+      uint64_t batch = 0;
+      while ((cqe = uring->peek_cqe())) {
+        batch++;
+        uint64_t user_data = cqe->user_data;
+        int cqe_res = cqe->res;
+        uint32_t flags = cqe->flags;
+        uring->cqe_seen();
+        this->handle_completion(user_data, cqe_res, flags);
+        this->close_pending();
+      }
+      if (batch > 0)
+        metrics.event_batch.record(batch);
+    }
+  } catch (const std::exception &e) {
+    LOG_ERROR("Server error: " << e.what());
+    return 1;
+  }
+  return 0;
+}
+
+void Server::handle_completion(uint64_t user_data, int res, uint32_t flags) {
+  int fd = user_data_fd(user_data);
+  uint32_t generation = user_data_generation(user_data);
+  bool more = flags & IORING_CQE_F_MORE;
+
+  if (user_data == Uring::RECYCLE_USER_DATA) {
+    errno = -res;
+    perror("io_uring provide buffers");
+    return;
+  }
+
+  // completions of closed connections are stale, the fd may be reused
+  auto find_conn = [this, fd, generation]() -> Connection * {
+    auto it = connections.find(fd);
+    if (it == connections.end() ||
+        (it->second->generation & 0xffffff) != generation)
+      return nullptr;
+    return it->second.get();
+  };
+
+  switch (user_data_op(user_data)) {
+  case OP_ACCEPT: {
+    if (res >= 0) {
+      sockaddr_in client_addr = {};
+      socklen_t addrlen = sizeof(client_addr);
+      getpeername(res, (sockaddr *)&client_addr, &addrlen);
+      this->add_connection(res, client_addr);
+    } else {
+      errno = -res;
+      perror("accept");
+    }
+    if (!more) {
+      io_uring_sqe *sqe = uring->get_sqe();
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = server_socket;
+      sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+      sqe->user_data = user_data;
+    }
+  } break;
+  case OP_RECV: {
+    Connection *conn = find_conn();
+    bool overflow = false;
+    if (flags & IORING_CQE_F_BUFFER) {
+      uint16_t buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+      const char *data = uring->buffer(buffer_id);
+      if (conn && res > 0)
+        metrics.bytes_received.add(res);
+      if (conn && res > 0 && conn->input.append(data, res)) {
+        // receives completed before the cancel of a handoff cannot wait
+        // in the socket
+        if (conn->migrate_to >= 0)
+          conn->input.defer(data, res);
+        else
+          overflow = true;
+      }
+      uring->recycle_buffer(buffer_id);
+    }
+    if (!conn)
+      break;
+    if (overflow) {
+      // the buffer holds an incomplete message larger than it can ever fit
+      this->close_connection(fd);
+      break;
+    }
+    if (!more)
+      conn->recv_armed = false;
+
+    if (res > 0) {
+      this->process_buffer(*conn);
+      // processing may have closed or migrated the connection
+      conn = find_conn();
+      if (!conn)
+        break;
+    } else if (res != -ENOBUFS && !conn->recv_cancelled) {
+      // end of stream or socket error
+      this->close_connection(fd);
+      break;
+    }
+
+    if (!conn->recv_armed) {
+      // rearming before buffers come back only fails again, so wait
+      if (res == -ENOBUFS && !conn->recv_cancelled) {
+        // the failure may predate the buffers of the last submission
+        if (starved_recvs.empty())
+          starved_since = returned_at_submit[0];
+        starved_recvs.emplace_back(fd, generation);
+      } else if (!conn->recv_cancelled) {
+        this->uring_arm_recv(*conn);
+      } else if (conn->migrate_to >= 0) {
+        this->migrate_connection(*conn);
+      }
+    }
+  } break;
+  case OP_SEND: {
+    Connection *conn = find_conn();
+    if (!conn) {
+      // the connection was closed while the send was pending
+      for (auto it = orphans.begin(); it != orphans.end(); ++it) {
+        if ((*it)->socket == fd &&
+            ((*it)->generation & 0xffffff) == generation) {
+          orphans.erase(it);
+          break;
+        }
+      }
+      break;
+    }
+
+    conn->send_in_flight = false;
+    if (res < 0) {
+      this->schedule_close(*conn);
+      break;
+    }
+    metrics.bytes_sent.add(res);
+    conn->consume(res);
+    if (conn->backlog())
+      this->uring_send(*conn);
+    else if (conn->migrate_to >= 0)
+      this->migrate_connection(*conn);
+  } break;
+  case OP_CANCEL:
+    break;
+  case OP_GLOBAL_TIMER:
+    this->run_timer();
+    this->uring_arm_timeout(OP_GLOBAL_TIMER, global_deadline,
+                            GLOBAL_TIMER_CHECK);
+    break;
+  case OP_GAME_TIMER:
+    // fired, or the deadline passed before a move reached it
+    armed_tick_deadline = 0;
+    this->run_game_tick();
+    break;
+  case OP_HANDOFF:
+    this->handle_handoffs();
+    if (!more) {
+      io_uring_sqe *sqe = uring->get_sqe();
+      sqe->opcode = IORING_OP_POLL_ADD;
+      sqe->fd = handoff_fd;
+      sqe->poll32_events = POLLIN;
+      sqe->len = IORING_POLL_ADD_MULTI;
+      sqe->user_data = user_data;
+    }
+    break;
+  }
+}
+
+void Server::uring_arm_recv(Connection &conn) {
+  io_uring_sqe *sqe = uring->get_sqe();
+  if (!sqe) {
+    this->schedule_close(conn);
+    return;
+  }
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = conn.socket;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_BUFFER_GROUP;
+  sqe->user_data = pack_user_data(OP_RECV, conn.generation, conn.socket);
+  conn.recv_armed = true;
+  conn.recv_cancelled = false;
+}
+
+void Server::uring_rearm_starved() {
+  uint64_t returned = uring->returned_buffers();
+  returned_at_submit[0] = returned_at_submit[1];
+  returned_at_submit[1] = returned;
+  if (starved_recvs.empty() || returned == starved_since)
+    return;
+  for (auto &starved : starved_recvs) {
+    auto it = connections.find(starved.first);
+    // closed or handed off meanwhile
+    if (it == connections.end() ||
+        (it->second->generation & 0xffffff) != starved.second)
+      continue;
+    Connection &conn = *it->second;
+    if (!conn.recv_armed && !conn.recv_cancelled && conn.migrate_to < 0)
+      this->uring_arm_recv(conn);
+  }
+  starved_recvs.clear();
+}
+
+void Server::uring_cancel_recv(Connection &conn) {
+  io_uring_sqe *sqe = uring->get_sqe();
+  if (!sqe)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = pack_user_data(OP_RECV, conn.generation, conn.socket);
+  sqe->user_data = pack_user_data(OP_CANCEL, conn.generation, conn.socket);
+  conn.recv_cancelled = true;
+}
+
+void Server::uring_send(Connection &conn) {
+  if (conn.send_in_flight)
+    return;
+
+  if (!conn.backlog())
+    return;
+
+  io_uring_sqe *sqe = uring->get_sqe();
+  if (!sqe) {
+    this->schedule_close(conn);
+    return;
+  }
+
+  // the queued messages are immutable and stay queued until consumed, so
+  // the kernel can read them in place
+  conn.send_hdr = {};
+  conn.send_hdr.msg_iov = conn.send_iov;
+  conn.send_hdr.msg_iovlen = conn.gather(conn.send_iov, SEND_IOV_MAX);
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = conn.socket;
+  sqe->addr = reinterpret_cast<uint64_t>(&conn.send_hdr);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = pack_user_data(OP_SEND, conn.generation, conn.socket);
+  conn.send_in_flight = true;
+}
+
+void Server::uring_arm_timeout(int kind, __kernel_timespec &deadline,
+                               int interval_sec) {
+  // like timerfd, ticks missed while busy are not made up for
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  deadline.tv_sec += interval_sec;
+  if (deadline.tv_sec < now.tv_sec ||
+      (deadline.tv_sec == now.tv_sec && deadline.tv_nsec < now.tv_nsec)) {
+    deadline = {now.tv_sec + interval_sec, now.tv_nsec};
+  }
+
+  io_uring_sqe *sqe = uring->get_sqe();
+  if (!sqe)
+    throw std::runtime_error("io_uring submission queue full");
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = reinterpret_cast<uint64_t>(&deadline);
+  sqe->len = 1;
+  sqe->timeout_flags = IORING_TIMEOUT_ABS;
+  sqe->user_data = pack_user_data(static_cast<uring_op>(kind), 0, 0);
+}
+
+void Server::uring_arm_game_timer(uint64_t deadline) {
+  io_uring_sqe *sqe = uring->get_sqe();
+  if (!sqe)
+    throw std::runtime_error("io_uring submission queue full");
+
+  // the kernel copies the deadline when it takes the request
+  tick_deadline = {static_cast<long long>(deadline / 1000000000),
+                   static_cast<long long>(deadline % 1000000000)};
+  if (armed_tick_deadline == 0) {
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&tick_deadline);
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = pack_user_data(OP_GAME_TIMER, 0, 0);
+  } else {
+    // move the pending timeout to the earlier deadline, if it already
+    // fired the update fails and the completion rearms it anyway
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->addr = pack_user_data(OP_GAME_TIMER, 0, 0);
+    sqe->addr2 = reinterpret_cast<uint64_t>(&tick_deadline);
+    sqe->timeout_flags = IORING_TIMEOUT_UPDATE | IORING_TIMEOUT_ABS;
+    sqe->user_data = pack_user_data(OP_CANCEL, 0, 0);
+  }
+}
@@ -0,0 +1,109 @@
+#include "tick_scheduler.hpp"
+#include <algorithm>
+#include <ctime>
+
+#define NS_PER_MS 1000000ull
+
+uint64_t monotonic_ns() {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+TickScheduler::TickScheduler() {}
+
+uint64_t TickScheduler::phase(int room_id, int tick_ms) {
+  // Fibonacci hashing keeps consecutive ids far apart within the period
+  uint64_t hash = static_cast<uint32_t>(room_id) * 2654435769u;
+  uint64_t interval = tick_ms * NS_PER_MS;
+  return ((hash & 0xffffffff) * interval) >> 32;
+}
+
+void TickScheduler::schedule(Game &game, uint64_t now) {
+  if (game.heap_index != NOT_SCHEDULED)
+    return;
+
+  uint64_t interval = game.tick_ms * NS_PER_MS;
+  uint64_t offset = phase(game.id, game.tick_ms);
+  uint64_t next = offset;
+  if (now >= offset)
+    next += ((now - offset) / interval + 1) * interval;
+  game.next_tick = next;
+
+  heap.push_back(&game);
+  game.heap_index = heap.size() - 1;
+  sift_up(game.heap_index);
+}
+
+void TickScheduler::cancel(Game &game) {
+  size_t index = game.heap_index;
+  if (index == NOT_SCHEDULED)
+    return;
+  game.heap_index = NOT_SCHEDULED;
+
+  Game *last = heap.back();
+  heap.pop_back();
+  if (index == heap.size())
+    return;
+  place(index, last);
+  sift_up(index);
+  sift_down(last->heap_index);
+}
+
+uint64_t TickScheduler::next_deadline() const {
+  return heap.empty() ? 0 : heap.front()->next_tick;
+}
+
+Game *TickScheduler::next_due(uint64_t now, int &ticks, int &skipped) {
+  if (heap.empty() || heap.front()->next_tick > now)
+    return nullptr;
+
+  Game *game = heap.front();
+  uint64_t interval = game->tick_ms * NS_PER_MS;
+  uint64_t missed = (now - game->next_tick) / interval;
+  game->next_tick += (missed + 1) * interval;
+  sift_down(0);
+
+  ticks = 1;
+  skipped = 0;
+  if (missed > 0) {
+    ticks += std::min<uint64_t>(missed, MAX_CATCH_UP_TICKS - 1);
+    skipped = missed + 1 - ticks;
+  }
+  return game;
+}
+
+void TickScheduler::place(size_t index, Game *game) {
+  heap[index] = game;
+  game->heap_index = index;
+}
+
+void TickScheduler::sift_up(size_t index) {
+  Game *game = heap[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (heap[parent]->next_tick <= game->next_tick)
+      break;
+    place(index, heap[parent]);
+    index = parent;
+  }
+  place(index, game);
+}
+
+void TickScheduler::sift_down(size_t index) {
+  Game *game = heap[index];
+  size_t size = heap.size();
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size &&
+        heap[child + 1]->next_tick < heap[child]->next_tick)
+      child++;
+    if (game->next_tick <= heap[child]->next_tick)
+      break;
+    place(index, heap[child]);
+    index = child;
+  }
+  place(index, game);
+}
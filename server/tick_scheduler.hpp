@@ -0,0 +1,91 @@
+#ifndef TICK_SCHEDULER_HPP
+#define TICK_SCHEDULER_HPP
+
+#include "game.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define MAX_CATCH_UP_TICKS 4
+#define NOT_SCHEDULED SIZE_MAX
+
+/**
+ * @brief Get the current CLOCK_MONOTONIC time.
+ *
+ * @return uint64_t Nanoseconds, the clock used by the tick deadlines.
+ */
+uint64_t monotonic_ns();
+
+/**
+ * @brief Schedules the ticks of active rooms, each at its own rate.
+ *
+ * Rooms are kept in a binary min-heap ordered by their next tick, so the
+ * reactor needs a single one-shot timer set to the earliest deadline.
+ * Every room ticks on a fixed grid of its interval shifted by a phase
+ * derived from the room id, which spreads the ticks of rooms with the same
+ * rate across the period. Deadlines advance along the grid rather than
+ * from the time a tick ran, so late ticks do not shift the following ones.
+ */
+class TickScheduler {
+public:
+  TickScheduler();
+
+  /**
+   * @brief Starts ticking a room on the next point of its grid.
+   *
+   * Does nothing if the room is already scheduled.
+   *
+   * @param game The room, its tick_ms must be set.
+   * @param now The current time in nanoseconds.
+   */
+  void schedule(Game &game, uint64_t now);
+
+  /**
+   * @brief Stops ticking a room.
+   *
+   * @param game The room, may not be scheduled.
+   */
+  void cancel(Game &game);
+
+  /**
+   * @brief Get the earliest tick deadline.
+   *
+   * @return uint64_t Deadline in nanoseconds, 0 if no room is scheduled.
+   */
+  uint64_t next_deadline() const;
+
+  /**
+   * @brief Takes the next room whose tick is due and moves its deadline
+   * past now.
+   *
+   * A room that fell more than one interval behind gets the missed ticks
+   * back, up to MAX_CATCH_UP_TICKS at once, the rest are skipped.
+   *
+   * @param now The current time in nanoseconds.
+   * @param ticks Set to the number of ticks the room may run at most.
+   * @param skipped Set to the number of missed ticks not made up for.
+   * @return Game* The room, nullptr if none is due.
+   */
+  Game *next_due(uint64_t now, int &ticks, int &skipped);
+
+  /**
+   * @brief Get the offset of a room's tick grid.
+   *
+   * The ticks of a room are due at the offset plus multiples of its
+   * interval on the monotonic clock.
+   *
+   * @param room_id The room id.
+   * @param tick_ms Tick interval of the room in milliseconds.
+   * @return uint64_t Offset in nanoseconds, less than the interval.
+   */
+  static uint64_t phase(int room_id, int tick_ms);
+
+private:
+  void place(size_t index, Game *game);
+  void sift_up(size_t index);
+  void sift_down(size_t index);
+
+  std::vector<Game *> heap; ///< Scheduled rooms, earliest tick first.
+};
+
+#endif // TICK_SCHEDULER_HPP
@@ -0,0 +1,138 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Entry of a TimingWheel, embedded in the object it times out.
+ *
+ * Unlinks itself when destroyed, so owners can be freed while scheduled.
+ */
+template <typename T> class TimerNode {
+public:
+  explicit TimerNode(T *owner = nullptr)
+      : owner(owner), prev(nullptr), next(nullptr), expires(0) {}
+  ~TimerNode() { unlink(); }
+
+  TimerNode(const TimerNode &) = delete;
+  TimerNode &operator=(const TimerNode &) = delete;
+
+  bool linked() const { return next != nullptr; }
+
+  void unlink() {
+    if (!linked())
+      return;
+    prev->next = next;
+    next->prev = prev;
+    prev = next = nullptr;
+  }
+
+  T *owner;         ///< Object passed to the expiry callback.
+  TimerNode *prev;  ///< Previous entry in the slot.
+  TimerNode *next;  ///< Next entry in the slot, nullptr if not scheduled.
+  uint64_t expires; ///< Wheel tick the entry expires at.
+};
+
+/**
+ * @brief Hashed timing wheel with a fixed tick length.
+ *
+ * Entries hash into slots by their expiry tick, (re)scheduling and
+ * cancelling are O(1) and advancing the wheel only visits the slots of the
+ * elapsed ticks. Timeouts longer than the number of slots stay in their
+ * slot for more than one rotation.
+ */
+template <typename T> class TimingWheel {
+public:
+  /**
+   * @brief Construct a new TimingWheel object.
+   *
+   * @param slots Number of slots, ideally more than the longest timeout.
+   */
+  explicit TimingWheel(size_t slots) : slots(slots), current(0) {
+    for (TimerNode<T> &head : this->slots) {
+      head.prev = head.next = &head;
+    }
+  }
+
+  ~TimingWheel() {
+    // detach entries that outlive the wheel
+    for (TimerNode<T> &head : slots) {
+      while (head.next != &head) {
+        head.next->unlink();
+      }
+      head.prev = head.next = nullptr;
+    }
+  }
+
+  TimingWheel(const TimingWheel &) = delete;
+  TimingWheel &operator=(const TimingWheel &) = delete;
+
+  /**
+   * @brief Schedules an entry, replacing its previous expiry.
+   *
+   * @param node The entry.
+   * @param delay Number of ticks from now until the entry expires.
+   */
+  void schedule(TimerNode<T> &node, uint64_t delay) {
+    uint64_t expires = current + delay;
+    // activity within the same tick does not move the entry
+    if (node.linked() && node.expires == expires)
+      return;
+    node.unlink();
+    node.expires = expires;
+    TimerNode<T> &head = slots[expires % slots.size()];
+    node.prev = head.prev;
+    node.next = &head;
+    head.prev->next = &node;
+    head.prev = &node;
+  }
+
+  /**
+   * @brief Advances the wheel, calling back expired entries.
+   *
+   * Expired entries are unlinked before the callback, which may destroy
+   * their owner or schedule other entries.
+   *
+   * @param now Current tick.
+   * @param on_expire Called with the owner of every expired entry.
+   */
+  template <typename F> void advance(uint64_t now, F on_expire) {
+    while (current < now) {
+      current++;
+      TimerNode<T> &head = slots[current % slots.size()];
+      if (head.next == &head)
+        continue;
+
+      // take the slot over, callbacks may unlink or schedule any entry
+      TimerNode<T> pending;
+      pending.next = head.next;
+      pending.prev = head.prev;
+      pending.next->prev = &pending;
+      pending.prev->next = &pending;
+      head.prev = head.next = &head;
+
+      while (pending.next != &pending) {
+        TimerNode<T> *node = pending.next;
+        node->unlink();
+        if (node->expires <= current) {
+          on_expire(node->owner);
+        } else {
+          // due in a later rotation
+          node->next = &head;
+          node->prev = head.prev;
+          head.prev->next = node;
+          head.prev = node;
+        }
+      }
+      pending.prev = pending.next = nullptr;
+    }
+  }
+
+private:
+  std::vector<TimerNode<T>> slots; ///< Sentinel heads of the slot lists.
+  uint64_t current;                ///< Last processed tick.
+};
+
+#endif // TIMING_WHEEL_HPP
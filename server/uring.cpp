@@ -0,0 +1,189 @@
+#include "uring.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                          unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                 nullptr, 0);
+}
+
+Uring::Uring(unsigned entries)
+    : sq_local_tail(0), to_submit(0), buf_group(0), buf_size(0),
+      returned(0) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd = io_uring_setup(entries, &params);
+  if (fd < 0)
+    throw std::runtime_error("io_uring_setup");
+
+  sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_size = cq_size = std::max(sq_size, cq_size);
+  }
+
+  sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("io_uring mmap");
+  }
+  cq_ptr = sq_ptr;
+  if (!single_mmap) {
+    cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      munmap(sq_ptr, sq_size);
+      close(fd);
+      throw std::runtime_error("io_uring mmap");
+    }
+  }
+
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_size,
+                                          PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, fd,
+                                          IORING_OFF_SQES));
+  if (sqes == MAP_FAILED) {
+    if (cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_size);
+    munmap(sq_ptr, sq_size);
+    close(fd);
+    throw std::runtime_error("io_uring mmap");
+  }
+
+  char *sq = static_cast<char *>(sq_ptr);
+  sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  sq_entries = params.sq_entries;
+  sq_local_tail = *sq_tail;
+
+  char *cq = static_cast<char *>(cq_ptr);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+}
+
+Uring::~Uring() {
+  munmap(sqes, sqes_size);
+  if (cq_ptr != sq_ptr)
+    munmap(cq_ptr, cq_size);
+  munmap(sq_ptr, sq_size);
+  close(fd);
+}
+
+io_uring_sqe *Uring::get_sqe() {
+  unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  if (sq_local_tail - head >= sq_entries) {
+    // queue full, hand the batch to the kernel to make room
+    submit_and_wait(0);
+    head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries)
+      return nullptr;
+  }
+
+  unsigned index = sq_local_tail & *sq_mask;
+  io_uring_sqe *sqe = &sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array[index] = index;
+  sq_local_tail++;
+  to_submit++;
+  return sqe;
+}
+
+int Uring::submit_and_wait(unsigned wait_nr) {
+  __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+  unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+  int res;
+  do {
+    res = io_uring_enter(fd, to_submit, wait_nr, flags);
+  } while (res < 0 && errno == EINTR);
+  if (res < 0)
+    return -errno;
+  to_submit -= std::min<unsigned>(to_submit, res);
+  return res;
+}
+
+io_uring_cqe *Uring::peek_cqe() {
+  unsigned head = *cq_head;
+  if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    return nullptr;
+  return &cqes[head & *cq_mask];
+}
+
+void Uring::cqe_seen() {
+  __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void Uring::setup_buffers(uint16_t group, unsigned count, unsigned size) {
+  buf_group = group;
+  buf_size = size;
+  buf_memory.resize(static_cast<size_t>(count) * size);
+  // every buffer can wait at once, recycling never allocates
+  pending_recycles.reserve(count);
+
+  io_uring_sqe *sqe = get_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = reinterpret_cast<uint64_t>(buf_memory.data());
+  sqe->len = size;
+  sqe->off = 0;
+  sqe->buf_group = group;
+  sqe->user_data = RECYCLE_USER_DATA;
+  submit_and_wait(1);
+
+  io_uring_cqe *cqe = peek_cqe();
+  int res = cqe ? cqe->res : -1;
+  if (cqe)
+    cqe_seen();
+  if (res < 0)
+    throw std::runtime_error("IORING_OP_PROVIDE_BUFFERS");
+}
+
+char *Uring::buffer(uint16_t id) {
+  return buf_memory.data() + static_cast<size_t>(id) * buf_size;
+}
+
+void Uring::recycle_buffer(uint16_t id) {
+  if (!pending_recycles.empty() || !provide_buffer(id))
+    pending_recycles.push_back(id);
+}
+
+void Uring::retry_recycles() {
+  size_t done = 0;
+  while (done < pending_recycles.size() &&
+         provide_buffer(pending_recycles[done]))
+    done++;
+  pending_recycles.erase(pending_recycles.begin(),
+                         pending_recycles.begin() + done);
+}
+
+bool Uring::provide_buffer(uint16_t id) {
+  io_uring_sqe *sqe = get_sqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = 1;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer(id));
+  sqe->len = buf_size;
+  sqe->off = id;
+  sqe->buf_group = buf_group;
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = RECYCLE_USER_DATA;
+  returned++;
+  return true;
+}
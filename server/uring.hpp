@@ -0,0 +1,132 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <vector>
+
+/**
+ * @brief Minimal io_uring instance built directly on the kernel interface.
+ *
+ * Owns the submission and completion rings and a single group of provided
+ * buffers used by multishot receives.
+ */
+class Uring {
+public:
+  /**
+   * @brief Construct a new Uring object.
+   *
+   * @param entries Number of submission queue entries.
+   * @throws std::runtime_error If the kernel does not support io_uring.
+   */
+  explicit Uring(unsigned entries);
+  ~Uring();
+
+  Uring(const Uring &) = delete;
+  Uring &operator=(const Uring &) = delete;
+
+  /**
+   * @brief Get a zeroed submission queue entry.
+   *
+   * Submits pending entries first if the queue is full.
+   *
+   * @return io_uring_sqe* The entry to fill in.
+   */
+  io_uring_sqe *get_sqe();
+
+  /**
+   * @brief Submits all queued entries and waits for completions.
+   *
+   * @param wait_nr Minimum number of completions to wait for.
+   * @return int Number of submitted entries, negative errno on error.
+   */
+  int submit_and_wait(unsigned wait_nr);
+
+  /**
+   * @brief Get the next completion without waiting.
+   *
+   * @return io_uring_cqe* The completion, nullptr if none is available.
+   */
+  io_uring_cqe *peek_cqe();
+
+  /**
+   * @brief Marks the completion returned by peek_cqe as consumed.
+   */
+  void cqe_seen();
+
+  /**
+   * @brief Provides the buffers used for receives to the kernel.
+   *
+   * @param group Buffer group id referenced by receive entries.
+   * @param count Number of buffers.
+   * @param size Size of each buffer in bytes.
+   */
+  void setup_buffers(uint16_t group, unsigned count, unsigned size);
+
+  /**
+   * @brief Get the memory of a provided buffer.
+   *
+   * @param id Buffer id from the completion flags.
+   * @return char* Start of the buffer.
+   */
+  char *buffer(uint16_t id);
+
+  /**
+   * @brief Returns a provided buffer to the kernel.
+   *
+   * Queued with the next submission, a completion is only posted on error
+   * and carries RECYCLE_USER_DATA. When the submission queue stays full the
+   * buffer is kept until retry_recycles, never lost to the group.
+   *
+   * @param id Buffer id from the completion flags.
+   */
+  void recycle_buffer(uint16_t id);
+
+  /**
+   * @brief Queues the buffers recycle_buffer could not, call once per loop.
+   */
+  void retry_recycles();
+
+  /**
+   * @brief Get the number of buffers given back to the kernel so far.
+   *
+   * @return uint64_t Buffers queued back to the group since setup.
+   */
+  uint64_t returned_buffers() const { return returned; }
+
+  static const uint64_t RECYCLE_USER_DATA = ~0ULL;
+
+  int fd; ///< The io_uring file descriptor.
+
+private:
+  bool provide_buffer(uint16_t id);
+
+  void *sq_ptr;
+  void *cq_ptr;
+  size_t sq_size;
+  size_t cq_size;
+  io_uring_sqe *sqes;
+  size_t sqes_size;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned sq_entries;
+  unsigned sq_local_tail; ///< Tail including entries not yet published.
+  unsigned to_submit;
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  io_uring_cqe *cqes;
+
+  uint16_t buf_group;
+  unsigned buf_size;
+  std::vector<char> buf_memory;
+  std::vector<uint16_t> pending_recycles; ///< Buffers waiting for an entry.
+  uint64_t returned; ///< Buffers queued back since setup.
+};
+
+#endif // URING_HPP